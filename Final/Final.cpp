@@ -4,6 +4,12 @@
 */
 #include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
+#include <cstring>          // strcmp
+#include <chrono>           // Benchmark timing
+#include <algorithm>        // max
+#include <cmath>            // abs
+#include <fstream>          // Comparison images
+#include <string>
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 #define STB_IMAGE_IMPLEMENTATION
@@ -13,6 +19,9 @@
 #include "floor.h"
 #include "pencil.h"
 #include "sphere.h"
+#include "benchmarksuite.h"
+#include "texturebaker.h"
+#include "frameuniforms.h"
 
 // GLM Math Header inclusions
 #define GLM_ENABLE_EXPERIMENTAL
@@ -43,10 +52,23 @@ namespace
     GLint gTexWrapMode = GL_REPEAT;
 
     std::vector<Object*> objects;
+    RenderQueue gRenderQueue;   // Draws of the frame, sorted to share state
+
+    // Startup options
+    bool gSerialInit = false;   // Initialize objects one after another on the context thread
+    int gStressObjects = 0;     // Extra spheres of distinct tessellations, to load test startup
+    bool gLodStats = false;     // Print the triangles and draw calls submitted per frame once a second
+    bool gCompareVertexFormats = false; // Render the scene with each vertex format and compare the images
+    bool gBenchStrips = false;  // Time triangle lists against strips on large spheres
+    bool gArenaStats = false;   // Print geometry arena usage after loading
+    bool gTextureStats = false; // Print texture cache hits and video memory after loading, and residency on exit
+    bool gBenchUpload = false;  // Time staged mesh uploads against generating straight into the mapped buffers
+    std::string gAssetArchive;  // Archive to load assets from; assets.pak beside the executable if not given
 
     // Shader programs
-    GLuint gCubeProgramId;
-    GLuint gLampProgramId;
+    ShaderProgram gCubeProgram;
+    ShaderProgram gLampProgram;
+    bool gShaderInfo = false;   // Print the uniforms and attributes each program was found to use
 
     // camera
     Camera gCamera(glm::vec3(0.0f, 0.0f, 7.0f));
@@ -58,10 +80,6 @@ namespace
     float gDeltaTime = 0.0f; // time between current frame and last frame
     float gLastFrame = 0.0f;
 
-    // Subject position and scale
-    glm::vec3 gCubePosition(0.0f, 0.0f, 0.0f);
-    glm::vec3 gCubeScale(2.0f);
-
     // Cube and light color
     //m::vec3 gObjectColor(0.6f, 0.5f, 0.75f);
     glm::vec3 gObjectColor(1.f, 0.2f, 0.0f);
@@ -86,8 +104,14 @@ void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 
 void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
+void UCreateScene();
+void UDestroyScene();
+bool UCompareVertexFormats();
+bool UBenchmarkStrips();
+bool UBenchmarkUpload();
+bool UPackAssets(const char* path);
+void UBenchmarkGenerators();
+bool UCheckSimdGenerators();
 
 
 /* Cube Vertex Shader Source Code*/
@@ -100,20 +124,63 @@ layout(location = 2) in vec2 textureCoordinate;
 out vec3 vertexNormal; // For outgoing normals to fragment shader
 out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 out vec2 vertexTextureCoordinate;
+flat out int vertexTextureLayer;
 
 //Uniform / Global variables for the  transform matrices
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Camera and lights, shared by every program and written once per frame; must match FrameData in frameuniforms.h
+layout(std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+    vec3 lightPos;
+    vec3 lightColor;
+    vec3 lightPos2;
+    vec3 lightColor2;
+};
+
+// Stacks and sectors of a unit sphere drawn from gl_VertexID with no attributes; 0 for meshes
+uniform ivec2 sphereTessellation;
+
+// Sample uTextureArray, with the layer packed into the texture coordinate as u + 2 * layer
+uniform bool textureLayered;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    vec3 vertexPosition = position;
+    vec3 vertexNormalIn = normal;
+    vec2 vertexUV = textureCoordinate;
+    if (sphereTessellation.x > 0)
+    {
+        // Six vertices per quad between stacks i, i + 1 and sectors j, j + 1, in Tessellation::fillSphere's winding
+        int quad = gl_VertexID / 6;
+        int corner = gl_VertexID % 6;
+        int i = quad / sphereTessellation.y + ((corner == 1 || corner == 4 || corner == 5) ? 1 : 0);
+        int j = quad % sphereTessellation.y + ((corner == 2 || corner == 3 || corner == 5) ? 1 : 0);
+
+        float stackAngle = 1.57079633 - 3.14159265 * float(i) / float(sphereTessellation.x);
+        float sectorAngle = 6.28318531 * float(j) / float(sphereTessellation.y);
+        vertexPosition = vec3(cos(stackAngle) * cos(sectorAngle), cos(stackAngle) * sin(sectorAngle), sin(stackAngle));
+        vertexNormalIn = vertexPosition;
+        vertexUV = vec2(float(j) / float(sphereTessellation.y), float(i) / float(sphereTessellation.x));
+    }
 
-    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+    // Every corner of a face has U in [2 * layer, 2 * layer + 1], so halving and flooring finds the layer
+    vertexTextureLayer = 0;
+    if (textureLayered)
+    {
+        float layer = floor(vertexUV.x * 0.5);
+        vertexUV.x -= 2.0 * layer;
+        vertexTextureLayer = int(layer);
+    }
 
-    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
-    vertexTextureCoordinate = textureCoordinate;
+    gl_Position = projection * view * model * vec4(vertexPosition, 1.0f); // Transforms vertices into clip coordinates
+
+    vertexFragmentPos = vec3(model * vec4(vertexPosition, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+
+    vertexNormal = mat3(transpose(inverse(model))) * vertexNormalIn; // get normal vectors in world space only and exclude normal translation properties
+    vertexTextureCoordinate = vertexUV;
 }
 );
 
@@ -124,17 +191,26 @@ const GLchar* cubeFragmentShaderSource = GLSL(410,
     in vec3 vertexNormal; // For incoming normals
 in vec3 vertexFragmentPos; // For incoming fragment position
 in vec2 vertexTextureCoordinate;
+flat in int vertexTextureLayer;
 
 out vec4 fragmentColor; // For outgoing cube color to the GPU
 
-// Uniform / Global variables for object color, light color, light position, and camera/view position
+// Uniform / Global variables for object color; light color, light position, and camera/view position come from the frame data
+// Camera and lights, shared by every program and written once per frame; must match FrameData in frameuniforms.h
+layout(std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+    vec3 lightPos;
+    vec3 lightColor;
+    vec3 lightPos2;
+    vec3 lightColor2;
+};
 uniform vec3 objectColor;
-uniform vec3 lightColor;
-uniform vec3 lightPos;
-uniform vec3 lightColor2;
-uniform vec3 lightPos2;
-uniform vec3 viewPosition;
 uniform sampler2D uTexture; // Useful when working with multiple textures
+uniform sampler2DArray uTextureArray; // Layered textures, e.g. the cube's colors
+uniform bool textureLayered;
 uniform vec2 uvScale;
 
 void main()
@@ -174,7 +250,8 @@ void main()
     vec3 specular2 = specularIntensity2 * specularComponent2 * lightColor2;
 
     // Texture holds the color to be used for all three components
-    vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+    vec4 textureColor = textureLayered ? texture(uTextureArray, vec3(vertexTextureCoordinate * uvScale, vertexTextureLayer))
+                                       : texture(uTexture, vertexTextureCoordinate * uvScale);
 
     // Calculate phong result
     vec3 phong = (ambient + diffuse + diffuse2 + specular + specular2) * textureColor.xyz;
@@ -191,8 +268,17 @@ const GLchar* lampVertexShaderSource = GLSL(410,
 
 //Uniform / Global variables for the  transform matrices
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Camera and lights, shared by every program and written once per frame; must match FrameData in frameuniforms.h
+layout(std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+    vec3 lightPos;
+    vec3 lightColor;
+    vec3 lightPos2;
+    vec3 lightColor2;
+};
 
 void main()
 {
@@ -214,51 +300,145 @@ void main()
 
 int main(int argc, char* argv[])
 {
+    // Command line modes
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--mesh-stats") == 0)
+            gReportMeshMemory = true;
+        else if (std::strcmp(argv[i], "--bench-generators") == 0)
+        {
+            UBenchmarkGenerators();
+            return EXIT_SUCCESS;
+        }
+        else if (std::strcmp(argv[i], "--check-simd") == 0)
+        {
+            return UCheckSimdGenerators() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (std::strcmp(argv[i], "--bake-textures") == 0 && i + 1 < argc)
+        {
+            return TextureBaker::bakeDirectory(argv[i + 1], ThreadPool::shared()) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (std::strcmp(argv[i], "--no-baked-textures") == 0)
+            TextureCache::useBaked() = false;
+        else if (std::strcmp(argv[i], "--pack-assets") == 0 && i + 1 < argc)
+        {
+            return UPackAssets(argv[i + 1]) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (std::strcmp(argv[i], "--asset-archive") == 0 && i + 1 < argc)
+            gAssetArchive = argv[++i];
+        else if (std::strcmp(argv[i], "--shader-info") == 0)
+            gShaderInfo = true;
+        else if (std::strcmp(argv[i], "--no-mesh-cache") == 0)
+            MeshCache::enabled() = false;
+        else if (std::strcmp(argv[i], "--no-lod") == 0)
+            gLodEnabled = false;
+        else if (std::strcmp(argv[i], "--no-cluster-culling") == 0)
+            gClusterCulling = false;
+        else if (std::strcmp(argv[i], "--lod-stats") == 0)
+            gLodStats = true;
+        else if (std::strcmp(argv[i], "--unsorted-draws") == 0)
+            RenderQueue::sorting() = false;
+        else if (std::strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (std::strcmp(argv[i], "float") == 0)
+                MeshRegistry::vertexFormat() = VertexFormat::Float32;
+            else if (std::strcmp(argv[i], "half") == 0)
+                MeshRegistry::vertexFormat() = VertexFormat::HalfPosition;
+            else if (std::strcmp(argv[i], "quantized") == 0)
+                MeshRegistry::vertexFormat() = VertexFormat::Quantized;
+            else
+                std::cout << "Unknown vertex format " << argv[i] << ", expected float, half or quantized" << std::endl;
+        }
+        else if (std::strcmp(argv[i], "--compare-vertex-formats") == 0)
+            gCompareVertexFormats = true;
+        else if (std::strcmp(argv[i], "--strips") == 0)
+            MeshRegistry::defaultTopology() = Tessellation::Topology::Strips;
+        else if (std::strcmp(argv[i], "--bench-strips") == 0)
+            gBenchStrips = true;
+        else if (std::strcmp(argv[i], "--arena-stats") == 0)
+            gArenaStats = true;
+        else if (std::strcmp(argv[i], "--texture-stats") == 0)
+            gTextureStats = true;
+        else if (std::strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+            TextureResidency::budget() = (size_t)std::atoi(argv[++i]) << 20;
+        else if (std::strcmp(argv[i], "--stream-textures") == 0)
+            TextureStreamer::enabled() = true;
+        else if (std::strcmp(argv[i], "--stream-budget") == 0 && i + 1 < argc)
+            TextureStreamer::frameBudget() = (size_t)std::atoi(argv[++i]) * 1024;
+        else if (std::strcmp(argv[i], "--bench-upload") == 0)
+            gBenchUpload = true;
+        else if (std::strcmp(argv[i], "--procedural-spheres") == 0)
+            Sphere::procedural() = true;
+        else if (std::strcmp(argv[i], "--serial-init") == 0)
+            gSerialInit = true;
+        else if (std::strcmp(argv[i], "--stress") == 0 && i + 1 < argc)
+            gStressObjects = std::atoi(argv[++i]);
+    }
+
+    // Assets are served from the archive when there is one, found beside the executable rather than in the working directory
+    if (!gAssetArchive.empty())
+    {
+        if (!AssetArchive::mount(gAssetArchive))
+            std::cout << "WARNING: Could not open asset archive " << gAssetArchive << ", using loose files" << std::endl;
+    }
+    else
+    {
+        std::string executable = argv[0];
+        AssetArchive::mount(executable.substr(0, executable.find_last_of("/\\") + 1) + "assets.pak");
+    }
+
     if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
 
     // Create the shader programs
-    if (!UCreateShaderProgram(cubeVertexShaderSource, cubeFragmentShaderSource, gCubeProgramId))
+    if (!gCubeProgram.create(cubeVertexShaderSource, cubeFragmentShaderSource))
         return EXIT_FAILURE;
 
-    if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
+    if (!gLampProgram.create(lampVertexShaderSource, lampFragmentShaderSource))
         return EXIT_FAILURE;
 
-    // Load objects
-    objects.push_back(new Rubiks());
-    objects.push_back(new Floor());
-    objects.push_back(new Pencil());
-    objects.push_back(new Sphere("./textures/baseball.jpg"));
-    objects.push_back(new Sphere("./textures/coaster.png"));
+    // Both read the camera and lights from the one per-frame buffer
+    if (!FrameUniforms::create() || !FrameUniforms::attach(gCubeProgram) || !FrameUniforms::attach(gLampProgram))
+        return EXIT_FAILURE;
 
-    for (auto obj : objects)
+    if (gShaderInfo)
     {
-        obj->initialize();
+        gCubeProgram.report("cube");
+        gLampProgram.report("lamp");
     }
 
-    // Move Rubik Cube
-    objects[0]->move(0, 0.01, 0);
-
-    // Move the pencil to a new location
-    objects[2]->move(-1.5, -0.4, 0);
-    objects[2]->rotate(135, 0, 0);
-
-    // Move Ball
-    objects[3]->move(1.7, 0, 0.5);
+    if (gCompareVertexFormats || gBenchStrips || gBenchUpload)
+    {
+        bool passed = gCompareVertexFormats ? UCompareVertexFormats() : gBenchStrips ? UBenchmarkStrips() : UBenchmarkUpload();
+        gCubeProgram.destroy();
+        gLampProgram.destroy();
+        FrameUniforms::destroy();
+        GeometryArena::destroyAll();
+        glfwTerminate();
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    // Coaster
-    objects[4]->move(-0.6, -0.47, 2);
-    objects[4]->scale(1.5, 0.05, 1.5);
+    // Load objects
+    auto loadStart = std::chrono::steady_clock::now();
+    UCreateScene();
+    if (gArenaStats)
+        GeometryArena::reportAll();
+    if (gTextureStats)
+        TextureCache::report();
 
     // tell OpenGL for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gCubeProgramId);
     // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gCubeProgramId, "uTexture"), 0);
+    gCubeProgram.set(ShaderProgram::Texture, 0);
+    // and array textures as unit 1, since a unit may only be read through one sampler type
+    gCubeProgram.set(ShaderProgram::TextureArray, 1);
 
     // Sets the background color of the window to black (it will be implicitly used by glClear)
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
     // Render loop
+    bool firstFrame = true;
+    float lastStatsTime = 0.0f;
     while (!glfwWindowShouldClose(gWindow))
     {
         // per-frame timing
@@ -272,18 +452,55 @@ int main(int argc, char* argv[])
         // Render this frame
         URender();
 
+        // Upload this frame's share of the textures still streaming in
+        TextureStreamer::update();
+
+        // Shrink textures not drawn lately if over the memory budget, or bring back ones drawn again
+        TextureResidency::update();
+
+        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+        glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+
+        if (firstFrame)
+        {
+            glFinish();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - loadStart;
+            std::cout << "INFO: Time to first frame: " << elapsed.count() << " ms for " << objects.size() << " objects ("
+                      << (gSerialInit ? "serial" : "parallel") << " init, " << ThreadPool::shared().size() << " workers)" << std::endl;
+            firstFrame = false;
+        }
+
+        if (gLodStats && currentFrame - lastStatsTime >= 1.0f)
+        {
+            const FrameStats& stats = Object::frameStats();
+            size_t submitted = stats.triangles + stats.trianglesCulled;
+            std::cout << "INFO: " << stats.triangles << " triangles in " << stats.drawCalls << " draw calls and " << stats.vaoBinds << " VAO binds per frame, "
+                      << (submitted > 0 ? 100.0 * stats.trianglesCulled / submitted : 0.0) << "% of triangles culled, "
+                      << ShaderProgram::stats().uploads << " uniform uploads (" << ShaderProgram::stats().skipped << " unchanged skipped), "
+                      << FrameUniforms::stalls() << " frame data stalls, "
+                      << gRenderQueue.stats().packets << " draw packets with " << gRenderQueue.stats().unsorted.total() << " state changes as queued, "
+                      << gRenderQueue.stats().sorted.total() << " submitted (" << gRenderQueue.stats().sorted.programs << " programs, "
+                      << gRenderQueue.stats().sorted.vertexArrays << " VAOs, " << gRenderQueue.stats().sorted.textures << " textures)"
+                      << (gLodEnabled ? "" : " (LOD off)") << (gClusterCulling ? "" : " (culling off)") << std::endl;
+            lastStatsTime = currentFrame;
+        }
+
         glfwPollEvents();
     }
 
     // Release shader programs
-    UDestroyShaderProgram(gCubeProgramId);
-    UDestroyShaderProgram(gLampProgramId);
+    gCubeProgram.destroy();
+    gLampProgram.destroy();
+    FrameUniforms::destroy();
+
+    if (gTextureStats)
+        TextureResidency::report();
 
     // Clean up dynamically allocated objects
-    for (auto obj : objects)
-    {
-        delete obj;
-    }
+    UDestroyScene();
+    GeometryArena::destroyAll();
+    TextureStreamer::destroy();
+    TextureResidency::destroy();
 
     glfwTerminate();
     return EXIT_SUCCESS; // Terminates the program successfully
@@ -338,6 +555,9 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     // Displays GPU OpenGL version
     std::cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
 
+    // Strip meshes separate their strips with the restart index
+    Object::enablePrimitiveRestart();
+
     return true;
 }
 
@@ -461,13 +681,8 @@ void URender()
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // CUBE: draw cube
-    //----------------
-    // Set the shader to be used
-    glUseProgram(gCubeProgramId);
-
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 model = glm::translate(gCubePosition) * glm::scale(gCubeScale);
+    // The render queue puts the shader in use with the first draw
+    ShaderProgram::stats() = ShaderProgram::Stats();
 
     // camera/view transformation
     glm::mat4 view = gCamera.GetViewMatrix();
@@ -475,113 +690,375 @@ void URender()
     // Creates a perspective projection
     glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
 
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gCubeProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gCubeProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gCubeProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the Cube Shader program for the cube color, light color, light position, and camera position
-    GLint objectColorLoc = glGetUniformLocation(gCubeProgramId, "objectColor");
-    GLint lightColorLoc = glGetUniformLocation(gCubeProgramId, "lightColor");
-    GLint lightPositionLoc = glGetUniformLocation(gCubeProgramId, "lightPos");
-    GLint lightColorLoc2 = glGetUniformLocation(gCubeProgramId, "lightColor2");
-    GLint lightPositionLoc2 = glGetUniformLocation(gCubeProgramId, "lightPos2");
-    GLint viewPositionLoc = glGetUniformLocation(gCubeProgramId, "viewPosition");
-
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(lightColorLoc, gLightColor.r, gLightColor.g, gLightColor.b);
-    glUniform3f(lightPositionLoc, gLightPosition.x, gLightPosition.y, gLightPosition.z);
-    glUniform3f(lightColorLoc2, 0.8f, 0.8f, 0.8f); // Second light color
-    glUniform3f(lightPositionLoc2, 3.0f, 0.0f, 0.0f); // Second light position
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    GLint UVScaleLoc = glGetUniformLocation(gCubeProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-    // Draw objects
+    // Camera and light data go to every program at once through the frame uniform buffer
+    FrameData frame = {};
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewPosition = gCamera.Position;
+    frame.lightPos = gLightPosition;
+    frame.lightColor = gLightColor;
+    frame.lightPos2 = glm::vec3(3.0f, 0.0f, 0.0f); // Second light position
+    frame.lightColor2 = glm::vec3(0.8f, 0.8f, 0.8f); // Second light color
+    FrameUniforms::write(frame);
+
+    // Levels of detail are picked against this frame's camera
+    Object::beginFrame(view, projection, (float)WINDOW_HEIGHT);
+
+    // Passes the rest to the Shader program; values that did not change since the last frame are not sent again.
+    // Each draw's model matrix is set by the render queue.
+    gCubeProgram.set(ShaderProgram::ObjectColor, gObjectColor);
+    gCubeProgram.set(ShaderProgram::UVScale, gUVScale);
+
+    // Queue the objects' draws, then sort them by state and draw
+    gRenderQueue.begin(view);
     for (auto obj : objects)
     {
-        obj->draw(modelLoc);
+        obj->prioritizeTextures();
+        obj->draw(gRenderQueue, gCubeProgram);
     }
+    gRenderQueue.submit();
 
     // Deactivate the Vertex Array Object and shader program
     glBindVertexArray(0);
     glUseProgram(0);
+}
+
+
+// Create, initialize and place the scene's objects
+void UCreateScene()
+{
+    objects.push_back(new Rubiks());
+    objects.push_back(new Floor());
+    objects.push_back(new Pencil());
+    objects.push_back(new Sphere("./textures/baseball.jpg"));
+    objects.push_back(new Sphere("./textures/coaster.png"));
+
+    const char* stressTextures[] = { "./textures/baseball.jpg", "./textures/coaster.png", "./textures/table.jpg", "./textures/blue.png" };
+    for (int i = 0; i < gStressObjects; ++i)
+    {
+        Sphere* sphere = new Sphere(stressTextures[i % 4], 32 + i, 32 + i);
+        sphere->move(-5.0f + (i % 20) * 0.5f, 2.0f + (i / 20) * 0.5f, -5.0f);
+        sphere->scale(0.2f, 0.2f, 0.2f);
+        objects.push_back(sphere);
+    }
 
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    bool initialized = true;
+    if (gSerialInit)
+    {
+        for (auto obj : objects)
+        {
+            if (!obj->initialize())
+                initialized = false;
+        }
+    }
+    else
+    {
+        initialized = Object::initializeAll(objects, ThreadPool::shared());
+    }
+    if (!initialized)
+        std::cout << "WARNING: Some objects failed to load and may be missing from the scene" << std::endl;
+
+    // Move Rubik Cube
+    objects[0]->move(0, 0.01, 0);
+
+    // Move the pencil to a new location
+    objects[2]->move(-1.5, -0.4, 0);
+    objects[2]->rotate(135, 0, 0);
+
+    // Move Ball
+    objects[3]->move(1.7, 0, 0.5);
+
+    // Coaster
+    objects[4]->move(-0.6, -0.47, 2);
+    objects[4]->scale(1.5, 0.05, 1.5);
 }
 
 
-// Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+void UDestroyScene()
 {
-    // Compilation and linkage error reporting
-    int success = 0;
-    char infoLog[512];
-
-    // Create a Shader program object.
-    programId = glCreateProgram();
-
-    // Create the vertex and fragment shader objects
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Retrive the shader source
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
-
-    // Compile the vertex shader, and print compilation errors (if any)
-    glCompileShader(vertexShaderId); // compile the vertex shader
-    // check for shader compile errors
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
+    for (auto obj : objects)
     {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+        delete obj;
+    }
+    objects.clear();
+}
 
-        return false;
+
+// Pack the textures, baked ones included, and the cached meshes into one archive
+bool UPackAssets(const char* path)
+{
+    std::vector<std::string> files = AssetArchive::listFiles("./textures");
+    for (const std::string& file : AssetArchive::listFiles(MeshCache::directory()))
+    {
+        if (file.size() > 5 && file.compare(file.size() - 5, 5, ".mesh") == 0)
+            files.push_back(file);
     }
+    return AssetArchive::pack(path, files);
+}
 
-    glCompileShader(fragmentShaderId); // compile the fragment shader
-    // check for shader compile errors
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
+
+// Time the runtime-parameter generators against the compile-time specialized ones (CPU work only, no GL context needed)
+void UBenchmarkGenerators()
+{
+    using Clock = std::chrono::high_resolution_clock;
+    const int iterations = 50;
+
+    std::cout << "Vertex kernels: " << Tessellation::Simd::isaName(Tessellation::Simd::activeIsa()) << std::endl;
+
+    auto report = [&](const char* name, double runtimeMs, double fixedMs)
     {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+        std::cout << name << ": runtime " << runtimeMs / iterations << " ms, compile-time " << fixedMs / iterations
+                  << " ms, speedup " << runtimeMs / fixedMs << "x" << std::endl;
+    };
 
-        return false;
+    auto time = [&](auto&& generate)
+    {
+        float checksum = 0;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            checksum += generate();
+        }
+        std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+
+        // Keep the optimizer from discarding the work
+        if (checksum == 12345.0f)
+            std::cout << checksum << std::endl;
+        return elapsed.count();
+    };
+
+    report("Sphere 200x200",
+        time([] { return Tessellation::buildSphere(0.5f, 200, 200).vertices[8]; }),
+        time([] { return Tessellation::buildSphere<200, 200>(0.5f)->vertices[8]; }));
+    report("Cylinder 6",
+        time([] { return Tessellation::buildCylinder(0.1f, 3.0f, 6).vertices[8]; }),
+        time([] { return Tessellation::buildCylinder<6>(0.1f, 3.0f)->vertices[8]; }));
+    report("Cylinder 16",
+        time([] { return Tessellation::buildCylinder(0.1f, 0.2f, 16).vertices[8]; }),
+        time([] { return Tessellation::buildCylinder<16>(0.1f, 0.2f)->vertices[8]; }));
+    report("Cone 16",
+        time([] { return Tessellation::buildCone(0.1f, 0.1f, 16).vertices[8]; }),
+        time([] { return Tessellation::buildCone<16>(0.1f, 0.1f)->vertices[8]; }));
+}
+
+
+// Compare the SSE2/AVX2 generator kernels against the scalar path on the same parameters
+bool UCheckSimdGenerators()
+{
+    using namespace Tessellation;
+    const Simd::Isa detected = Simd::detectIsa();
+    const float epsilon = 1e-5f;
+
+    auto build = [](Simd::Isa isa)
+    {
+        Simd::activeIsa() = isa;
+        std::vector<Geometry> meshes;
+        meshes.push_back(buildSphere(0.5f, 200, 200));
+        meshes.push_back(buildSphere(0.5f, 7, 13));
+        meshes.push_back(buildCylinder(0.1f, 3.0f, 6));
+        meshes.push_back(buildCylinder(0.1f, 1.0f, 1021));
+        meshes.push_back(buildCone(0.1f, 0.1f, 16));
+        meshes.push_back(buildCone(0.1f, 0.1f, 1021));
+        return meshes;
+    };
+
+    std::vector<Geometry> reference = build(Simd::Isa::Scalar);
+    bool passed = true;
+    for (Simd::Isa isa : { Simd::Isa::SSE2, Simd::Isa::AVX2 })
+    {
+        if (isa > detected)
+            continue;
+
+        std::vector<Geometry> meshes = build(isa);
+        float maxError = 0;
+        bool indicesMatch = true;
+        for (size_t m = 0; m < meshes.size(); ++m)
+        {
+            for (size_t i = 0; i < meshes[m].vertices.size(); ++i)
+            {
+                maxError = std::max(maxError, std::abs(meshes[m].vertices[i] - reference[m].vertices[i]));
+            }
+            indicesMatch = indicesMatch && meshes[m].indices == reference[m].indices;
+        }
+
+        bool ok = indicesMatch && maxError <= epsilon;
+        std::cout << Simd::isaName(isa) << ": max vertex error " << maxError << (indicesMatch ? "" : ", indices differ")
+                  << (ok ? " PASSED" : " FAILED") << std::endl;
+        passed = passed && ok;
     }
 
-    // Attached compiled shaders to the shader program
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
+    Simd::activeIsa() = detected;
+    return passed;
+}
+
+
+// Render the scene once per vertex format and compare each against the float layout.
+// The frames are also written out as PPM images for a visual check.
+bool UCompareVertexFormats()
+{
+    const VertexFormat formats[] = { VertexFormat::Float32, VertexFormat::HalfPosition, VertexFormat::Quantized };
+    const double minPsnr = 40.0;
 
-    glLinkProgram(programId);   // links the shader program
-    // check for linking errors
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success)
+    int width, height;
+    glfwGetFramebufferSize(gWindow, &width, &height);
+
+    gCubeProgram.use();
+    gCubeProgram.set(ShaderProgram::Texture, 0);
+    gCubeProgram.set(ShaderProgram::TextureArray, 1);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    std::vector<unsigned char> reference;
+    bool passed = true;
+    for (VertexFormat format : formats)
     {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        // The registry frees every mesh with the scene, so the next scene uploads in the new format
+        MeshRegistry::vertexFormat() = format;
+        UCreateScene();
+        URender();
 
-        return false;
+        std::vector<unsigned char> pixels(width * height * 3);
+        glReadBuffer(GL_BACK);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        UDestroyScene();
+
+        std::string name = std::string("vertex_format_") + VertexPacking::formatName(format) + ".ppm";
+        std::ofstream image(name, std::ios::binary);
+        image << "P6\n" << width << " " << height << "\n255\n";
+        for (int y = height - 1; y >= 0; --y)
+        {
+            image.write((const char*)&pixels[y * width * 3], width * 3);
+        }
+
+        if (format == VertexFormat::Float32)
+        {
+            reference = pixels;
+            continue;
+        }
+
+        int maxDifference = 0;
+        size_t changedPixels = 0;
+        double squaredError = 0;
+        for (size_t i = 0; i < pixels.size(); i += 3)
+        {
+            int pixelDifference = 0;
+            for (size_t c = i; c < i + 3; ++c)
+            {
+                int difference = std::abs((int)pixels[c] - (int)reference[c]);
+                pixelDifference = std::max(pixelDifference, difference);
+                squaredError += difference * difference;
+            }
+            maxDifference = std::max(maxDifference, pixelDifference);
+            if (pixelDifference > 2)
+                ++changedPixels;
+        }
+
+        double mse = squaredError / pixels.size();
+        double psnr = mse > 0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+        bool ok = psnr >= minPsnr;
+        std::cout << VertexPacking::formatName(format) << ": " << VertexPacking::vertexSize(format) << " bytes per vertex, PSNR "
+                  << psnr << " dB, max difference " << maxDifference << ", " << changedPixels << " pixels off by more than 2"
+                  << (ok ? " PASSED" : " FAILED") << std::endl;
+        passed = passed && ok;
     }
 
-    glUseProgram(programId);    // Uses the shader program
+    return passed;
+}
+
+
+// Time the same large spheres drawn as indexed triangle lists and as strips, on the GPU
+bool UBenchmarkStrips()
+{
+    const std::uint32_t tessellations[] = { 256, 512, 1024 };
+    const int draws = 50;
 
+    // Keep the large test meshes out of the disk cache
+    bool cacheEnabled = MeshCache::enabled();
+    MeshCache::enabled() = false;
+
+    gCubeProgram.use();
+    glm::mat4 model = glm::scale(glm::vec3(2.0f));
+    glm::mat4 view = gCamera.GetViewMatrix();
+    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+    gCubeProgram.set(ShaderProgram::Model, model);
+    FrameData frame = {};
+    frame.view = view;
+    frame.projection = projection;
+    FrameUniforms::write(frame);
+    glEnable(GL_DEPTH_TEST);
+
+    GLuint query;
+    glGenQueries(1, &query);
+    for (std::uint32_t tessellation : tessellations)
+    {
+        for (Tessellation::Topology topology : { Tessellation::Topology::Triangles, Tessellation::Topology::Strips })
+        {
+            MeshHandle mesh = MeshRegistry::upload(MeshRegistry::generateSphere(0.5f, tessellation, tessellation, topology));
+            glBindVertexArray(mesh->vao);
+
+            // One untimed draw so first use costs stay out of the measurement
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            Object::drawMesh(*mesh);
+            glFinish();
+
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            for (int i = 0; i < draws; ++i)
+            {
+                Object::drawMesh(*mesh);
+            }
+            glEndQuery(GL_TIME_ELAPSED);
+
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+            std::cout << "Sphere " << tessellation << "x" << tessellation << " "
+                      << (topology == Tessellation::Topology::Strips ? "strips" : "triangles") << ": " << mesh->indices << " indices ("
+                      << mesh->indices * sizeof(GLuint) / 1024 << " KB), " << elapsed / 1e6 / draws << " ms per draw" << std::endl;
+        }
+    }
+    glDeleteQueries(1, &query);
+    glBindVertexArray(0);
+
+    MeshCache::enabled() = cacheEnabled;
     return true;
 }
 
 
-void UDestroyShaderProgram(GLuint programId)
+// Upload the scene's 200x200 sphere repeatedly, generated straight into the mapped arena
+// and then generated on the host and copied in, reporting time and peak memory for each.
+// The direct path runs first, as the peak can only go up.
+bool UBenchmarkUpload()
 {
-    glDeleteProgram(programId);
-}
\ No newline at end of file
+    using Clock = std::chrono::high_resolution_clock;
+    const std::uint32_t stacks = 200, sectors = 200;
+    const int meshes = 32;
+    const size_t meshBytes = Tessellation::sphereVertexCount(stacks, sectors) * Tessellation::k_FloatsPerVertex * sizeof(float) +
+                             Tessellation::sphereIndexCount(stacks, sectors) * sizeof(GLuint);
+
+    std::cout << "Sphere " << stacks << "x" << sectors << ", " << meshBytes / 1024 << " KB per mesh, buffer storage "
+              << (GLEW_ARB_buffer_storage ? "immutable" : "mutable") << std::endl;
+
+    auto run = [&](const char* name, size_t hostBytes, auto&& create)
+    {
+        std::vector<GLMesh> created(meshes);
+        Clock::time_point start = Clock::now();
+        for (GLMesh& mesh : created)
+        {
+            create(mesh);
+        }
+        glFinish();
+        std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+
+        std::cout << name << ": " << elapsed.count() / meshes << " ms per mesh, " << hostBytes / 1024 << " KB staged on the host per mesh, peak resident "
+                  << Benchmark::peakResidentBytes() / (1024 * 1024) << " MB" << std::endl;
+    };
+
+    run("Direct", 0, [&](GLMesh& mesh) { mesh = Object::makeSphere(0.5f, stacks, sectors); });
+    run("Staged", meshBytes, [&](GLMesh& mesh)
+    {
+        Tessellation::Geometry geometry = Tessellation::buildSphere(0.5f, stacks, sectors);
+        Object::createMesh(geometry.vertices.data(), geometry.vertices.size() * sizeof(float), geometry.indices.data(), geometry.indices.size(), mesh);
+    });
+
+    if (gArenaStats)
+        GeometryArena::reportAll();
+    return true;
+}
@@ -0,0 +1,270 @@
+/*
+*   Brad Follett
+*   Final Project benchmark suite
+*
+*   Its own executable, built by CMakeLists.txt, so it can run headless on Linux
+*   and so replacing operator new to count allocations does not touch the renderer.
+*/
+#include <iostream>         // cout, cerr
+#include <cstdlib>          // EXIT_FAILURE, malloc
+#include <cstring>          // memset
+#include <fstream>          // JSON report
+#include <new>              // bad_alloc
+#include <string>
+#include <vector>
+#include <GL/glew.h>        // GLEW library
+#include <GLFW/glfw3.h>     // GLFW library
+#define STB_IMAGE_IMPLEMENTATION
+
+
+#include "object.h"
+#include "benchmarksuite.h"
+
+// Unnamed namespace
+namespace
+{
+    const char* const WINDOW_TITLE = "Final Project Benchmarks";
+}
+
+bool URunBenchmarkSuite(const char* path);
+GLFWwindow* UCreateBenchmarkContext();
+
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        std::cout << "Usage: " << argv[0] << " RESULTS.json" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return URunBenchmarkSuite(argv[1]) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// Count heap allocations for the benchmark suite
+void* operator new(std::size_t size)
+{
+    Benchmark::allocations().fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size > 0 ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+
+// Time the primitive generators, image flip, decode and texture upload across sizes and
+// write the results to a JSON file. The CPU cases need no context; the GL ones get a
+// hidden window, or a software context when there is no display, and are skipped
+// if neither can be created.
+bool URunBenchmarkSuite(const char* path)
+{
+    using namespace Tessellation;
+    const std::uint32_t tessellations[] = { 8, 16, 32, 64, 128, 256, 512, 1024 };
+    const int imageSizes[] = { 256, 512, 1024, 2048, 4096, 8192 };
+    const char* imageFiles[] = { "./textures/baseball.jpg", "./textures/coaster.png", "./textures/pencil_tip.jpg", "./textures/table.jpg" };
+
+    Benchmark::Report report;
+    report.vertexKernels = Simd::isaName(Simd::activeIsa());
+    volatile float sink = 0;   // Keeps the optimizer from discarding generated geometry
+
+    auto add = [&](const Benchmark::Result& result)
+    {
+        std::cout << result.name << " {" << result.parameters << "}: " << result.nsPerCall / std::max(result.units, 1.0) << " ns per "
+                  << result.unit << ", " << result.allocationsPerCall << " allocations per call" << std::endl;
+        report.results.push_back(result);
+    };
+
+    auto geometryCase = [](const char* name, bool gl, std::uint32_t stacks, std::uint32_t sectors, size_t vertices, size_t indices)
+    {
+        Benchmark::Result result;
+        result.name = name;
+        result.gl = gl;
+        result.parameters = (stacks > 0 ? "\"stacks\": " + std::to_string(stacks) + ", " : std::string()) + "\"sectors\": " + std::to_string(sectors);
+        result.units = (double)vertices;
+        result.bytes = (double)(vertices * k_FloatsPerVertex * sizeof(float) + indices * sizeof(GLuint));
+        return result;
+    };
+
+    auto imageCase = [](const char* name, bool gl, const std::string& parameters, int width, int height, int channels)
+    {
+        Benchmark::Result result;
+        result.name = name;
+        result.gl = gl;
+        result.parameters = parameters + "\"width\": " + std::to_string(width) + ", \"height\": " + std::to_string(height) +
+                            ", \"channels\": " + std::to_string(channels);
+        result.unit = "Pixel";
+        result.unitsName = "pixels";
+        result.units = (double)width * height;
+        result.bytes = (double)width * height * channels;
+        return result;
+    };
+
+    // CPU: generation into host buffers, as the registry and its workers do it
+    for (std::uint32_t n : tessellations)
+    {
+        add(Benchmark::measure(geometryCase("buildSphere", false, n, n, sphereVertexCount(n, n), sphereIndexCount(n, n)),
+            [&] { sink = buildSphere(0.5f, n, n).vertices[8]; }));
+        add(Benchmark::measure(geometryCase("buildCylinder", false, 0, n, cylinderVertexCount(n), cylinderIndexCount(n)),
+            [&] { sink = buildCylinder(0.1f, 1.0f, n).vertices[8]; }));
+        add(Benchmark::measure(geometryCase("buildCone", false, 0, n, coneVertexCount(n), coneIndexCount(n)),
+            [&] { sink = buildCone(0.1f, 0.1f, n).vertices[8]; }));
+    }
+
+    for (int size : imageSizes)
+    {
+        for (int channels : { 3, 4 })
+        {
+            std::vector<unsigned char> pixels((size_t)size * size * channels, 0x80);
+            add(Benchmark::measure(imageCase("flipImageVertically", false, "", size, size, channels),
+                [&] { TextureCache::flipImageVertically(pixels.data(), size, size, channels); }));
+        }
+    }
+
+    std::vector<std::string> decodedFiles;
+    for (const char* file : imageFiles)
+    {
+        TextureImage image;
+        if (!TextureCache::loadImage(file, image))
+        {
+            std::cout << "INFO: Could not load " << file << ", skipping it" << std::endl;
+            continue;
+        }
+
+        decodedFiles.push_back(file);
+        std::string parameters = "\"file\": \"" + Benchmark::escape(file) + "\", ";
+        add(Benchmark::measure(imageCase("loadImage", false, parameters, image.width, image.height, image.channels),
+            [&] { TextureImage decoded; TextureCache::loadImage(file, decoded); }));
+    }
+
+    // GL: the same work ending in the driver, timed through glFinish
+    GLFWwindow* window = UCreateBenchmarkContext();
+    if (window)
+    {
+        report.glRenderer = (const char*)glGetString(GL_RENDERER);
+        report.glVersion = (const char*)glGetString(GL_VERSION);
+        auto finish = [] { glFinish(); };
+
+        for (std::uint32_t n : tessellations)
+        {
+            add(Benchmark::measure(geometryCase("makeSphere", true, n, n, sphereVertexCount(n, n), sphereIndexCount(n, n)),
+                [&] { Object::makeSphere(0.5f, n, n); }, finish));
+            add(Benchmark::measure(geometryCase("makeCylinder", true, 0, n, cylinderVertexCount(n), cylinderIndexCount(n)),
+                [&] { Object::makeCylinder(0.1f, 1.0f, n); }, finish));
+            add(Benchmark::measure(geometryCase("makeCone", true, 0, n, coneVertexCount(n), coneIndexCount(n)),
+                [&] { Object::makeCone(0.1f, 0.1f, n); }, finish));
+        }
+
+        GLint maxTextureSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+        for (int size : imageSizes)
+        {
+            if (size > maxTextureSize)
+            {
+                std::cout << "INFO: Skipping " << size << " pixel textures, the limit is " << maxTextureSize << std::endl;
+                continue;
+            }
+
+            // Released with stbi_image_free, which is free() unless stb is configured otherwise
+            TextureImage image;
+            image.width = image.height = size;
+            image.channels = 4;
+            image.pixels.reset((unsigned char*)std::malloc((size_t)size * size * 4));
+            std::memset(image.pixels.get(), 0x80, (size_t)size * size * 4);
+            add(Benchmark::measure(imageCase("uploadTexture", true, "", size, size, 4), [&]
+            {
+                GLuint textureId;
+                if (TextureCache::uploadTexture(image, textureId))
+                    glDeleteTextures(1, &textureId);
+            }, finish));
+        }
+
+        for (const std::string& file : decodedFiles)
+        {
+            TextureImage image;
+            TextureCache::loadImage(file.c_str(), image);
+            std::string parameters = "\"file\": \"" + Benchmark::escape(file) + "\", ";
+            add(Benchmark::measure(imageCase("createTexture", true, parameters, image.width, image.height, image.channels), [&]
+            {
+                GLuint textureId;
+                if (TextureCache::createTexture(file.c_str(), textureId))
+                    glDeleteTextures(1, &textureId);
+            }, finish));
+        }
+
+        GeometryArena::destroyAll();
+        glfwDestroyWindow(window);
+    }
+    else
+    {
+        std::cout << "INFO: No GL context, skipping the GL benchmarks" << std::endl;
+    }
+    glfwTerminate();
+
+    std::ofstream out(path);
+    report.write(out);
+    if (!out)
+    {
+        std::cout << "Could not write " << path << std::endl;
+        return false;
+    }
+
+    std::cout << "INFO: Wrote " << report.results.size() << " results to " << path << std::endl;
+    return true;
+}
+
+
+// Hidden window for the GL benchmarks. Without a display it asks GLFW 3.4 for its
+// null platform and an OSMesa context, which renders in software on any machine.
+GLFWwindow* UCreateBenchmarkContext()
+{
+    bool headless = false;
+#if defined(__linux__) && defined(GLFW_PLATFORM_NULL)
+    headless = !std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY");
+    if (headless)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+
+    if (!glfwInit())
+        return nullptr;
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef GLFW_OSMESA_CONTEXT_API
+    if (headless)
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#endif
+
+    GLFWwindow* window = glfwCreateWindow(64, 64, WINDOW_TITLE, NULL, NULL);
+    if (!window)
+        return nullptr;
+    glfwMakeContextCurrent(window);
+
+    glewExperimental = GL_TRUE;
+    GLenum result = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // GLEW looks for a GLX display after loading the GL functions, and an OSMesa context has none
+    if (headless && result == GLEW_ERROR_NO_GLX_DISPLAY)
+        result = GLEW_OK;
+#endif
+    if (result != GLEW_OK)
+    {
+        std::cerr << glewGetErrorString(result) << std::endl;
+        glfwDestroyWindow(window);
+        return nullptr;
+    }
+    return window;
+}
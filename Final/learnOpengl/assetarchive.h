@@ -0,0 +1,279 @@
+#ifndef ASSETARCHIVE_H
+#define ASSETARCHIVE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include <direct.h>         // _getcwd
+#else
+#include <dirent.h>
+#endif
+
+// Textures and cached meshes packed into one file, so a launch maps a single
+// archive instead of opening every asset. The file is a header, an index sorted
+// by name, the names, and then each asset's bytes starting on a page boundary.
+// Assets are looked up by the path they would have as loose files, relative to
+// the working directory the archive was packed from, and handed out as views of
+// the mapping: nothing is read until it is touched, and nothing is copied.
+class AssetArchive
+{
+public:
+    static const std::uint32_t k_Version = 1;
+    static const size_t k_Alignment = 4096;
+
+    struct Header
+    {
+        char magic[4];                  // "PACK"
+        std::uint32_t version;
+        std::uint32_t entryCount;
+        std::uint32_t namesBytes;
+        std::uint64_t indexOffset;      // Entry table, sorted by name
+        std::uint64_t namesOffset;
+    };
+
+    struct Entry
+    {
+        std::uint64_t offset;           // Multiple of k_Alignment
+        std::uint64_t size;
+        std::uint32_t nameOffset;       // Into the names
+        std::uint32_t nameLength;
+    };
+
+    // Serve assets from an archive from now on; call before anything is loaded
+    static bool mount(const std::string& path)
+    {
+        std::shared_ptr<MappedFile> file = MappedFile::open(path);
+        if (!file)
+            return false;
+
+        Header header;
+        if (file->size() < sizeof(Header))
+            return reject(path, "truncated");
+        std::memcpy(&header, file->data(), sizeof(Header));
+        if (std::memcmp(header.magic, "PACK", 4) != 0 || header.version != k_Version)
+            return reject(path, "old version");
+        if (header.indexOffset % 8 != 0 || header.indexOffset > file->size() || header.entryCount > (file->size() - header.indexOffset) / sizeof(Entry) ||
+            header.namesOffset > file->size() || header.namesBytes > file->size() - header.namesOffset)
+            return reject(path, "bad offsets");
+
+        const Entry* entries = (const Entry*)(file->data() + header.indexOffset);
+        for (std::uint32_t i = 0; i < header.entryCount; ++i)
+        {
+            const Entry& entry = entries[i];
+            if (entry.offset > file->size() || entry.size > file->size() - entry.offset ||
+                entry.nameOffset > header.namesBytes || entry.nameLength > header.namesBytes - entry.nameOffset)
+                return reject(path, "bad offsets");
+        }
+
+        // The assets are read in one go from here, rather than a page fault at a time as they are decoded
+        file->prefetch();
+        state().file = file;
+        state().header = header;
+        std::cout << "INFO: Mounted asset archive " << path << ": " << header.entryCount << " assets, " << file->size() / 1024 << " KB" << std::endl;
+        return true;
+    }
+
+    // Asset from the mounted archive, or nullptr if it is not in it
+    static std::shared_ptr<MappedFile> find(const std::string& path)
+    {
+        const State& mounted = state();
+        if (!mounted.file)
+            return nullptr;
+
+        std::string key = name(path);
+        const Entry* begin = (const Entry*)(mounted.file->data() + mounted.header.indexOffset);
+        const Entry* end = begin + mounted.header.entryCount;
+        const Entry* found = std::lower_bound(begin, end, key, [](const Entry& entry, const std::string& key) { return compare(entry, key) < 0; });
+        if (found == end || compare(*found, key) != 0)
+            return nullptr;
+        return MappedFile::view(mounted.file, (size_t)found->offset, (size_t)found->size);
+    }
+
+    // Asset from the archive, or else the loose file; nullptr if neither exists
+    static std::shared_ptr<MappedFile> open(const std::string& path)
+    {
+        std::shared_ptr<MappedFile> file = find(path);
+        return file ? file : MappedFile::open(path);
+    }
+
+    // Write an archive of loose files, named as given; a file already in the archive is replaced
+    static bool pack(const std::string& path, const std::vector<std::string>& files)
+    {
+        std::vector<std::string> names;
+        for (const std::string& file : files)
+            names.push_back(name(file));
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+
+        Header header = {};
+        std::memcpy(header.magic, "PACK", 4);
+        header.version = k_Version;
+        header.entryCount = (std::uint32_t)names.size();
+        header.indexOffset = sizeof(Header);
+        header.namesOffset = header.indexOffset + names.size() * sizeof(Entry);
+
+        std::string nameBytes;
+        std::vector<Entry> entries(names.size());
+        std::vector<std::shared_ptr<MappedFile>> contents(names.size());
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            contents[i] = MappedFile::open(names[i]);
+            if (!contents[i])
+            {
+                std::cout << "WARNING: Could not read " << names[i] << " to pack it" << std::endl;
+                return false;
+            }
+            entries[i].nameOffset = (std::uint32_t)nameBytes.size();
+            entries[i].nameLength = (std::uint32_t)names[i].size();
+            nameBytes += names[i];
+        }
+        header.namesBytes = (std::uint32_t)nameBytes.size();
+
+        std::uint64_t offset = header.namesOffset + nameBytes.size();
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            offset = (offset + k_Alignment - 1) / k_Alignment * k_Alignment;
+            entries[i].offset = offset;
+            entries[i].size = contents[i]->size();
+            offset += contents[i]->size();
+        }
+
+        // Write beside the final name and swap it in, as MeshCache does
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            out.write((const char*)&header, sizeof(Header));
+            out.write((const char*)entries.data(), entries.size() * sizeof(Entry));
+            out.write(nameBytes.data(), nameBytes.size());
+            std::uint64_t written = header.namesOffset + nameBytes.size();
+            static const char zeros[k_Alignment] = {};
+            for (size_t i = 0; i < names.size(); ++i)
+            {
+                out.write(zeros, (std::streamsize)(entries[i].offset - written));
+                out.write((const char*)contents[i]->data(), contents[i]->size());
+                written = entries[i].offset + entries[i].size;
+            }
+            if (!out)
+            {
+                std::cout << "WARNING: Could not write asset archive " << tempPath << std::endl;
+                return false;
+            }
+        }
+
+        std::remove(path.c_str());
+        if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+        {
+            std::cout << "WARNING: Could not write asset archive " << path << std::endl;
+            return false;
+        }
+        std::cout << "INFO: Packed " << names.size() << " assets into " << path << ", " << offset / 1024 << " KB" << std::endl;
+        return true;
+    }
+
+    // Regular files in a directory, as "directory/name", sorted
+    static std::vector<std::string> listFiles(const std::string& directory)
+    {
+        std::vector<std::string> files;
+#ifdef _WIN32
+        WIN32_FIND_DATAA found;
+        HANDLE search = FindFirstFileA((directory + "\\*").c_str(), &found);
+        if (search != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                    files.push_back(directory + "/" + found.cFileName);
+            } while (FindNextFileA(search, &found));
+            FindClose(search);
+        }
+#else
+        if (DIR* dir = opendir(directory.c_str()))
+        {
+            while (dirent* entry = readdir(dir))
+            {
+                std::string file = directory + "/" + entry->d_name;
+                struct stat info;
+                if (stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+                    files.push_back(file);
+            }
+            closedir(dir);
+        }
+#endif
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+private:
+    struct State
+    {
+        std::shared_ptr<const MappedFile> file;
+        Header header = {};
+    };
+
+    // Index name of a path: forward slashes, relative to the working directory, without "./"
+    static std::string name(const std::string& path)
+    {
+        std::string result = path;
+        std::replace(result.begin(), result.end(), '\\', '/');
+
+        static const std::string s_WorkingDirectory = workingDirectory();
+        if (!s_WorkingDirectory.empty() && result.compare(0, s_WorkingDirectory.size(), s_WorkingDirectory) == 0)
+            result.erase(0, s_WorkingDirectory.size());
+        while (result.compare(0, 2, "./") == 0)
+            result.erase(0, 2);
+        return result;
+    }
+
+    // With forward slashes and a trailing one
+    static std::string workingDirectory()
+    {
+        char buffer[4096];
+#ifdef _WIN32
+        if (!_getcwd(buffer, sizeof(buffer)))
+            return std::string();
+#else
+        if (!getcwd(buffer, sizeof(buffer)))
+            return std::string();
+#endif
+        std::string directory(buffer);
+        std::replace(directory.begin(), directory.end(), '\\', '/');
+        if (directory.empty() || directory.back() != '/')
+            directory += '/';
+        return directory;
+    }
+
+    // Orders entries as std::string does the names they were sorted by
+    static int compare(const Entry& entry, const std::string& key)
+    {
+        const State& mounted = state();
+        const char* name = (const char*)mounted.file->data() + mounted.header.namesOffset + entry.nameOffset;
+        int order = std::memcmp(name, key.data(), std::min<size_t>(entry.nameLength, key.size()));
+        if (order != 0)
+            return order;
+        return entry.nameLength < key.size() ? -1 : entry.nameLength > key.size() ? 1 : 0;
+    }
+
+    static bool reject(const std::string& path, const char* reason)
+    {
+        std::cout << "WARNING: Asset archive " << path << " not mounted (" << reason << "), using loose files" << std::endl;
+        return false;
+    }
+
+    static State& state()
+    {
+        static State s_State;
+        return s_State;
+    }
+};
+
+#endif // ASSETARCHIVE_H
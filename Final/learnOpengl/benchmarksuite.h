@@ -0,0 +1,190 @@
+#ifndef BENCHMARKSUITE_H
+#define BENCHMARKSUITE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>          // Peak working set
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>   // Peak resident set
+#endif
+
+// Timing, allocation and memory counters for the microbenchmarks, and the JSON
+// they are reported in. The benchmarks themselves are in bench_main.cpp.
+namespace Benchmark
+{
+    // Keep running a case until it has taken this long, within the iteration limits
+    const double k_MinSeconds = 0.2;
+    const int k_MinIterations = 3;
+    const int k_MaxIterations = 10000;
+
+    // Heap allocations made through operator new, counted by the replacement in bench_main.cpp; 0 in other programs
+    inline std::atomic<std::size_t>& allocations()
+    {
+        static std::atomic<std::size_t> s_Allocations(0);
+        return s_Allocations;
+    }
+
+    // Most memory the process has had resident since start, or since the last resetPeakResident()
+    inline std::size_t peakResidentBytes()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.PeakWorkingSetSize;
+        return 0;
+#else
+#ifdef __linux__
+        // VmHWM follows resetPeakResident(), unlike ru_maxrss
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.compare(0, 6, "VmHWM:") == 0)
+                return (std::size_t)std::stoull(line.substr(6)) * 1024;
+        }
+#endif
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return (std::size_t)usage.ru_maxrss;         // Bytes
+#else
+        return (std::size_t)usage.ru_maxrss * 1024;  // Kilobytes
+#endif
+#endif
+    }
+
+    // Start the peak over from the current resident size; only Linux can, elsewhere the peak is since start
+    inline bool resetPeakResident()
+    {
+#ifdef __linux__
+        std::ofstream clearRefs("/proc/self/clear_refs");
+        clearRefs << "5";
+        return (bool)clearRefs.flush();
+#else
+        return false;
+#endif
+    }
+
+    // One measured case
+    struct Result
+    {
+        std::string name;           // Function measured
+        std::string parameters;     // JSON members describing the case, e.g. "\"sectors\": 64"
+        bool gl = false;            // Needs a GL context
+        const char* unit = "Vertex";        // What the work is counted in, for nsPer<unit>
+        const char* unitsName = "vertices"; // JSON name of the units count
+        double units = 0;                   // Units of work per call
+        double bytes = 0;           // Bytes produced or moved per call
+        int iterations = 0;
+        double nsPerCall = 0;
+        double allocationsPerCall = 0;
+        std::size_t peakResidentBytes = 0;
+    };
+
+    // Time run() until k_MinSeconds have passed; finish() is called before the clock stops, e.g. glFinish
+    template <typename Run, typename Finish>
+    Result measure(Result result, Run run, Finish finish)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        // One untimed call so first use costs stay out of the measurement
+        run();
+        finish();
+
+        resetPeakResident();
+        std::size_t allocationsBefore = allocations().load();
+        Clock::time_point start = Clock::now();
+        std::chrono::duration<double> elapsed(0);
+        int iterations = 0;
+        while (iterations < k_MinIterations || (elapsed.count() < k_MinSeconds && iterations < k_MaxIterations))
+        {
+            run();
+            ++iterations;
+            if (iterations >= k_MinIterations)
+            {
+                finish();
+                elapsed = Clock::now() - start;
+            }
+        }
+
+        result.iterations = iterations;
+        result.nsPerCall = elapsed.count() * 1e9 / iterations;
+        result.allocationsPerCall = (double)(allocations().load() - allocationsBefore) / iterations;
+        result.peakResidentBytes = peakResidentBytes();
+        return result;
+    }
+
+    template <typename Run>
+    Result measure(Result result, Run run)
+    {
+        return measure(result, run, [] { });
+    }
+
+    inline std::string escape(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if ((unsigned char)c >= 0x20)
+                escaped += c;
+        }
+        return escaped;
+    }
+
+    // Results of a run and what they ran on, written as one JSON document
+    struct Report
+    {
+        std::string vertexKernels;
+        std::string glRenderer;     // Empty when there was no GL context
+        std::string glVersion;
+        std::vector<Result> results;
+
+        void write(std::ostream& out) const
+        {
+            out << "{\n";
+            out << "  \"vertexKernels\": \"" << escape(vertexKernels) << "\",\n";
+            if (glRenderer.empty())
+                out << "  \"gl\": null,\n";
+            else
+                out << "  \"gl\": { \"renderer\": \"" << escape(glRenderer) << "\", \"version\": \"" << escape(glVersion) << "\" },\n";
+#ifdef __linux__
+            out << "  \"peakResidentPerCase\": true,\n";
+#else
+            out << "  \"peakResidentPerCase\": false,\n";    // Peak since start
+#endif
+            out << "  \"results\": [\n";
+            for (size_t i = 0; i < results.size(); ++i)
+            {
+                const Result& r = results[i];
+                double seconds = r.nsPerCall * 1e-9;
+                out << "    { \"name\": \"" << r.name << "\", \"gl\": " << (r.gl ? "true" : "false") << ", " << r.parameters
+                    << ", \"" << r.unitsName << "\": " << r.units << ", \"iterations\": " << r.iterations
+                    << ", \"nsPerCall\": " << r.nsPerCall << ", \"nsPer" << r.unit << "\": " << r.nsPerCall / std::max(r.units, 1.0)
+                    << ", \"bytesPerSecond\": " << (seconds > 0 ? r.bytes / seconds : 0) << ", \"allocationsPerCall\": " << r.allocationsPerCall
+                    << ", \"peakResidentBytes\": " << r.peakResidentBytes << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+            }
+            out << "  ]\n}\n";
+        }
+    };
+}
+
+#endif // BENCHMARKSUITE_H
@@ -0,0 +1,197 @@
+#ifndef FRAMEUNIFORMS_H
+#define FRAMEUNIFORMS_H
+
+#include <cstring>
+#include <iostream>
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "shaderprogram.h"
+
+// Camera and lights for a frame, laid out as the std140 FrameData block the shaders declare:
+//
+//     layout(std140) uniform FrameData
+//     {
+//         mat4 view;
+//         mat4 projection;
+//         vec3 viewPosition;
+//         vec3 lightPos;
+//         vec3 lightColor;
+//         vec3 lightPos2;
+//         vec3 lightColor2;
+//     };
+//
+// A vec3 takes 16 bytes in std140, hence the padding.
+struct FrameData
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 viewPosition;
+    float pad0;
+    glm::vec3 lightPos;
+    float pad1;
+    glm::vec3 lightColor;
+    float pad2;
+    glm::vec3 lightPos2;
+    float pad3;
+    glm::vec3 lightColor2;
+    float pad4;
+};
+
+static_assert(sizeof(FrameData) == 208, "FrameData must match the std140 layout of the shaders' block");
+
+// The FrameData block shared by every program, written once per frame into a
+// ring of k_Frames slots of one uniform buffer. Each slot is fenced when the
+// next frame starts, so a frame only waits if the GPU is still reading the slot
+// from k_Frames frames ago. With buffer storage (core in 4.4) the buffer stays
+// mapped; otherwise each write maps its slot unsynchronized, the fence having
+// already made that safe. Programs only need attach() once after linking.
+class FrameUniforms
+{
+public:
+    // Uniform buffer binding point of the block
+    static const GLuint k_Binding = 0;
+
+    // Slots in the ring, so up to two frames can still be in flight on the GPU while the third is written
+    static const int k_Frames = 3;
+
+    // Create the buffer; call once the context exists
+    static bool create()
+    {
+        State& ring = state();
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        ring.slotBytes = (sizeof(FrameData) + alignment - 1) / alignment * alignment;
+        GLsizeiptr bytes = ring.slotBytes * k_Frames;
+
+        glGenBuffers(1, &ring.buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, ring.buffer);
+        if (GLEW_ARB_buffer_storage)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_UNIFORM_BUFFER, bytes, nullptr, flags);
+            ring.mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, bytes, flags);
+        }
+        else
+            glBufferData(GL_UNIFORM_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        if (GLEW_ARB_buffer_storage && !ring.mapped)
+        {
+            std::cout << "WARNING: Could not map the frame uniform buffer" << std::endl;
+            destroy();
+            return false;
+        }
+        return true;
+    }
+
+    // Source a program's FrameData block from the ring; false if its layout does not match
+    static bool attach(const ShaderProgram& program)
+    {
+        const ShaderProgram::Variable* block = program.block("FrameData");
+        if (!block)
+            return true;    // Nothing in the program reads it
+        if (block->size != (GLint)sizeof(FrameData))
+        {
+            std::cout << "ERROR::SHADER::PROGRAM::FrameData block is " << block->size << " bytes, expected " << sizeof(FrameData) << std::endl;
+            return false;
+        }
+        glUniformBlockBinding(program.id(), (GLuint)block->location, k_Binding);
+        return true;
+    }
+
+    // Write this frame's data to the next slot and bind it for the draws that follow
+    static void write(const FrameData& data)
+    {
+        State& ring = state();
+
+        // Everything issued since the last write read the current slot
+        if (ring.written)
+            ring.fences[ring.slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        ring.slot = (ring.slot + 1) % k_Frames;
+        ring.written = true;
+        wait(ring.fences[ring.slot]);
+
+        GLintptr offset = ring.slot * ring.slotBytes;
+        if (ring.mapped)
+            std::memcpy(ring.mapped + offset, &data, sizeof(FrameData));
+        else
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, ring.buffer);
+            void* mapped = glMapBufferRange(GL_UNIFORM_BUFFER, offset, sizeof(FrameData),
+                                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (mapped)
+            {
+                std::memcpy(mapped, &data, sizeof(FrameData));
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+            }
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        glBindBufferRange(GL_UNIFORM_BUFFER, k_Binding, ring.buffer, offset, sizeof(FrameData));
+    }
+
+    // Writes that had to wait for the GPU to release their slot, since the start
+    static size_t& stalls()
+    {
+        static size_t s_Stalls = 0;
+        return s_Stalls;
+    }
+
+    // Release the buffer and fences; call before the context goes away
+    static void destroy()
+    {
+        State& ring = state();
+        for (GLsync& fence : ring.fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = 0;
+        }
+        if (ring.mapped)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, ring.buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &ring.buffer);
+        ring = State();
+    }
+
+private:
+    struct State
+    {
+        GLuint buffer = 0;
+        unsigned char* mapped = nullptr;    // Whole buffer, if persistently mapped
+        GLsizeiptr slotBytes = 0;           // sizeof(FrameData) rounded up to the offset alignment
+        GLsync fences[k_Frames] = {};       // Set while the GPU may still be reading a slot
+        int slot = 0;
+        bool written = false;               // Whether the current slot holds data the GPU may read
+    };
+
+    // Block until the GPU is past a fence, then delete it
+    static void wait(GLsync& fence)
+    {
+        if (!fence)
+            return;
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            ++stalls();
+            do
+            {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    static State& state()
+    {
+        static State s_State;
+        return s_State;
+    }
+};
+
+#endif // FRAMEUNIFORMS_H
@@ -0,0 +1,462 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+#include <GL/glew.h>
+
+#include "vertexformat.h"
+
+class GeometryArena;
+
+// Where a mesh lives in its arena. The arena moves ranges when it grows or
+// defragments and updates them in place; the range is freed with the last
+// mesh referring to it.
+struct ArenaRange
+{
+    GeometryArena* arena = nullptr;
+    GLint baseVertex = 0;       // First vertex, added to every index
+    GLuint firstIndex = 0;      // First index in the element buffer
+    GLuint vertexCount = 0;
+    GLuint indexCount = 0;
+
+    ~ArenaRange();
+};
+
+// One large vertex buffer and element buffer for every mesh of a vertex
+// format, suballocated from free lists and drawn through a single VAO with
+// base-vertex draws. Indices stay relative to their mesh's first vertex, so a
+// mesh can move without rewriting them.
+class GeometryArena
+{
+public:
+    // Free space is compacted instead of growing once this much of it is unusable
+    static constexpr float k_DefragmentThreshold = 0.5f;
+
+    // Arena for a vertex format; created on first use, on the context thread
+    static GeometryArena& get(VertexFormat format)
+    {
+        static GeometryArena* s_Arenas[3] = {};
+        GeometryArena*& arena = s_Arenas[(int)format];
+        if (!arena)
+        {
+            // Never destroyed: ranges may outlive the GL objects, which destroyAll() frees
+            arena = new GeometryArena(format);
+            arenas().push_back(arena);
+        }
+        return *arena;
+    }
+
+    // Release the GL objects of every arena; call before the context goes away
+    static void destroyAll()
+    {
+        for (GeometryArena* arena : arenas())
+        {
+            glDeleteVertexArrays(1, &arena->m_Vao);
+            glDeleteBuffers(1, &arena->m_Vbo);
+            glDeleteBuffers(1, &arena->m_Ebo);
+            arena->m_Vao = arena->m_Vbo = arena->m_Ebo = 0;
+        }
+    }
+
+    static void reportAll()
+    {
+        for (GeometryArena* arena : arenas())
+        {
+            arena->report();
+        }
+    }
+
+    // Attribute pointers for a vertex format, for the bound VAO and array buffer
+    static void setVertexAttributes(VertexFormat format)
+    {
+        const GLint stride = (GLint)VertexPacking::vertexSize(format);
+        if (format == VertexFormat::Float32)
+        {
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 3));
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 6));
+        }
+        else
+        {
+            // Same shader inputs: the normalized integer types are converted back to floats on fetch
+            if (format == VertexFormat::HalfPosition)
+                glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(VertexPacking::PackedVertex, position));
+            else
+                glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(VertexPacking::PackedVertex, position));
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offsetof(VertexPacking::PackedVertex, normal));
+            glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(VertexPacking::PackedVertex, uv));
+        }
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+    }
+
+    // Copy a mesh into the arena; vertices are in this arena's format
+    std::shared_ptr<ArenaRange> allocate(const void* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount)
+    {
+        std::shared_ptr<ArenaRange> range = place(vertexCount, indexCount);
+        write(*range, vertices, indices);
+        ++m_CopiedUploads;
+        return range;
+    }
+
+    // Reserve space for a mesh and have fill(void* vertices, GLuint* indices) write it straight
+    // into the mapped buffers, with no copy on the host. The mapping is write only, so fill must
+    // not read back what it wrote. If mapping fails fill writes to host memory that is copied in.
+    template <typename Fill>
+    std::shared_ptr<ArenaRange> allocate(size_t vertexCount, size_t indexCount, Fill fill)
+    {
+        std::shared_ptr<ArenaRange> range = place(vertexCount, indexCount);
+
+        // Invalidating lets the driver skip preserving the old contents of freed space
+        const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_Vbo);
+        void* vertices = glMapBufferRange(GL_COPY_WRITE_BUFFER, range->baseVertex * m_Stride, vertexCount * m_Stride, access);
+        void* indices = nullptr;
+        if (indexCount > 0)
+        {
+            // The element buffer goes on the other copy target so both stay mapped together
+            glBindBuffer(GL_COPY_READ_BUFFER, m_Ebo);
+            indices = glMapBufferRange(GL_COPY_READ_BUFFER, range->firstIndex * sizeof(GLuint), indexCount * sizeof(GLuint), access);
+        }
+
+        bool mapped = vertices && (indices || indexCount == 0);
+        if (mapped)
+            fill(vertices, (GLuint*)indices);
+
+        // Unmapping fails if the contents were lost while mapped, e.g. on a display mode change
+        if (indices && glUnmapBuffer(GL_COPY_READ_BUFFER) == GL_FALSE)
+            mapped = false;
+        if (vertices && glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_FALSE)
+            mapped = false;
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        if (mapped)
+        {
+            ++m_MappedUploads;
+        }
+        else
+        {
+            std::vector<unsigned char> vertexData(vertexCount * m_Stride);
+            std::vector<GLuint> indexData(indexCount);
+            fill((void*)vertexData.data(), indexData.data());
+            write(*range, vertexData.data(), indexData.data());
+            ++m_CopiedUploads;
+        }
+        return range;
+    }
+
+    // Move every live range to the front of new buffers, leaving one free block at the end
+    void defragment()
+    {
+        GLuint vbo = createBuffer(m_VertexCapacity * m_Stride);
+        GLuint ebo = createBuffer(m_IndexCapacity * sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, m_Vbo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+
+        size_t vertexCursor = 0;
+        for (ArenaRange* range : sortedRanges())
+        {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, range->baseVertex * m_Stride, vertexCursor * m_Stride,
+                                range->vertexCount * m_Stride);
+            range->baseVertex = (GLint)vertexCursor;
+            vertexCursor += range->vertexCount;
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, m_Ebo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        size_t indexCursor = 0;
+        for (ArenaRange* range : sortedRanges())
+        {
+            if (range->indexCount == 0)
+                continue;
+
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, range->firstIndex * sizeof(GLuint), indexCursor * sizeof(GLuint),
+                                range->indexCount * sizeof(GLuint));
+            range->firstIndex = (GLuint)indexCursor;
+            indexCursor += range->indexCount;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        replaceBuffers(vbo, ebo);
+
+        m_FreeVertices.clear();
+        m_FreeIndices.clear();
+        release(m_FreeVertices, vertexCursor, m_VertexCapacity - vertexCursor);
+        release(m_FreeIndices, indexCursor, m_IndexCapacity - indexCursor);
+        ++m_Defragments;
+    }
+
+    // Share of free vertex space outside the largest free block, 0 when all of it is in one piece
+    float fragmentation() const
+    {
+        size_t total = 0, largest = 0;
+        for (const auto& block : m_FreeVertices)
+        {
+            total += block.second;
+            largest = std::max(largest, block.second);
+        }
+        return total > 0 ? 1.0f - (float)largest / total : 0.0f;
+    }
+
+    void report() const
+    {
+        size_t usedVertices = 0, usedIndices = 0;
+        for (ArenaRange* range : m_Ranges)
+        {
+            usedVertices += range->vertexCount;
+            usedIndices += range->indexCount;
+        }
+
+        std::cout << "INFO: Geometry arena (" << VertexPacking::formatName(m_Format) << "): " << m_Ranges.size() << " meshes, vertices "
+                  << usedVertices << "/" << m_VertexCapacity << " (" << usedVertices * m_Stride / 1024 << " of " << m_VertexCapacity * m_Stride / 1024
+                  << " KB), indices " << usedIndices << "/" << m_IndexCapacity << ", " << m_FreeVertices.size() << " free vertex blocks, fragmentation "
+                  << fragmentation() * 100.0f << "%, " << m_Grows << " grows, " << m_Defragments << " defragments, "
+                  << m_MappedUploads << " meshes written in place, " << m_CopiedUploads << " copied" << std::endl;
+    }
+
+    GLuint vao() const { return m_Vao; }
+    VertexFormat format() const { return m_Format; }
+
+private:
+    friend struct ArenaRange;
+
+    explicit GeometryArena(VertexFormat format)
+        : m_Format(format), m_Stride(VertexPacking::vertexSize(format))
+    {
+        m_Vbo = createBuffer(m_VertexCapacity * m_Stride);
+        m_Ebo = createBuffer(m_IndexCapacity * sizeof(GLuint));
+        glGenVertexArrays(1, &m_Vao);
+        bindBuffers();
+
+        release(m_FreeVertices, 0, m_VertexCapacity);
+        release(m_FreeIndices, 0, m_IndexCapacity);
+    }
+
+    static std::vector<GeometryArena*>& arenas()
+    {
+        static std::vector<GeometryArena*> s_Arenas;
+        return s_Arenas;
+    }
+
+    static GLuint createBuffer(size_t bytes)
+    {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        // Immutable storage where available (core in 4.4): the arena replaces buffers rather than resizing them anyway
+        if (GLEW_ARB_buffer_storage)
+            glBufferStorage(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT);
+        else
+            glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+
+    // Point the VAO at the current buffers
+    void bindBuffers()
+    {
+        glBindVertexArray(m_Vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_Vbo);
+        setVertexAttributes(m_Format);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Ebo);   // Stored in the VAO
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void replaceBuffers(GLuint vbo, GLuint ebo)
+    {
+        glDeleteBuffers(1, &m_Vbo);
+        glDeleteBuffers(1, &m_Ebo);
+        m_Vbo = vbo;
+        m_Ebo = ebo;
+        bindBuffers();
+    }
+
+    // Ranges in buffer order, so compaction keeps meshes allocated together next to each other
+    std::vector<ArenaRange*> sortedRanges() const
+    {
+        std::vector<ArenaRange*> ranges(m_Ranges.begin(), m_Ranges.end());
+        std::sort(ranges.begin(), ranges.end(), [](ArenaRange* a, ArenaRange* b) { return a->baseVertex < b->baseVertex; });
+        return ranges;
+    }
+
+    // Find space for a mesh, compacting or growing the buffers if there is none
+    std::shared_ptr<ArenaRange> place(size_t vertexCount, size_t indexCount)
+    {
+        auto range = std::make_shared<ArenaRange>();
+        range->arena = this;
+        range->vertexCount = (GLuint)vertexCount;
+        range->indexCount = (GLuint)indexCount;
+
+        size_t vertexOffset, indexOffset;
+        if (!reserve(vertexCount, indexCount, vertexOffset, indexOffset))
+        {
+            // Compact first if that leaves room, otherwise grow
+            if (fragmentation() >= k_DefragmentThreshold)
+                defragment();
+            if (!reserve(vertexCount, indexCount, vertexOffset, indexOffset))
+            {
+                grow(vertexCount, indexCount);
+                reserve(vertexCount, indexCount, vertexOffset, indexOffset);
+            }
+        }
+        range->baseVertex = (GLint)vertexOffset;
+        range->firstIndex = (GLuint)indexOffset;
+
+        m_Ranges.insert(range.get());
+        return range;
+    }
+
+    // Upload a mesh from host memory into its range
+    void write(const ArenaRange& range, const void* vertices, const GLuint* indices)
+    {
+        // Write through the copy target so the VAO's element buffer binding is left alone
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_Vbo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.baseVertex * m_Stride, range.vertexCount * m_Stride, vertices);
+        if (range.indexCount > 0)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_Ebo);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstIndex * sizeof(GLuint), range.indexCount * sizeof(GLuint), indices);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // Take space for a mesh from both free lists, or neither
+    bool reserve(size_t vertexCount, size_t indexCount, size_t& vertexOffset, size_t& indexOffset)
+    {
+        if (!take(m_FreeVertices, vertexCount, vertexOffset))
+            return false;
+        if (!take(m_FreeIndices, indexCount, indexOffset))
+        {
+            release(m_FreeVertices, vertexOffset, vertexCount);
+            return false;
+        }
+        return true;
+    }
+
+    // Double the buffers until the mesh fits in the space at their end
+    void grow(size_t vertexCount, size_t indexCount)
+    {
+        size_t vertexCapacity = m_VertexCapacity;
+        size_t indexCapacity = m_IndexCapacity;
+        while (vertexCapacity - m_VertexCapacity + tailFree(m_FreeVertices, m_VertexCapacity) < vertexCount)
+            vertexCapacity *= 2;
+        while (indexCapacity - m_IndexCapacity + tailFree(m_FreeIndices, m_IndexCapacity) < indexCount)
+            indexCapacity *= 2;
+
+        GLuint vbo = createBuffer(vertexCapacity * m_Stride);
+        GLuint ebo = createBuffer(indexCapacity * sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, m_Vbo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_VertexCapacity * m_Stride);
+        glBindBuffer(GL_COPY_READ_BUFFER, m_Ebo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_IndexCapacity * sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        replaceBuffers(vbo, ebo);
+
+        release(m_FreeVertices, m_VertexCapacity, vertexCapacity - m_VertexCapacity);
+        release(m_FreeIndices, m_IndexCapacity, indexCapacity - m_IndexCapacity);
+        m_VertexCapacity = vertexCapacity;
+        m_IndexCapacity = indexCapacity;
+        ++m_Grows;
+    }
+
+    // Size of the free block ending at the end of the buffer
+    static size_t tailFree(const std::map<size_t, size_t>& freeList, size_t capacity)
+    {
+        if (freeList.empty())
+            return 0;
+        auto last = std::prev(freeList.end());
+        return last->first + last->second == capacity ? last->second : 0;
+    }
+
+    // First fit from a free list of offset -> size blocks
+    static bool take(std::map<size_t, size_t>& freeList, size_t count, size_t& offset)
+    {
+        if (count == 0)
+        {
+            offset = 0;
+            return true;
+        }
+
+        for (auto block = freeList.begin(); block != freeList.end(); ++block)
+        {
+            if (block->second < count)
+                continue;
+
+            offset = block->first;
+            size_t remaining = block->second - count;
+            freeList.erase(block);
+            if (remaining > 0)
+                freeList[offset + count] = remaining;
+            return true;
+        }
+        return false;
+    }
+
+    // Return a block to a free list, merging it with its neighbours
+    static void release(std::map<size_t, size_t>& freeList, size_t offset, size_t count)
+    {
+        if (count == 0)
+            return;
+
+        auto next = freeList.lower_bound(offset);
+        if (next != freeList.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                offset = previous->first;
+                count += previous->second;
+                freeList.erase(previous);
+            }
+        }
+        if (next != freeList.end() && offset + count == next->first)
+        {
+            count += next->second;
+            freeList.erase(next);
+        }
+        freeList[offset] = count;
+    }
+
+    void release(ArenaRange& range)
+    {
+        m_Ranges.erase(&range);
+        release(m_FreeVertices, range.baseVertex, range.vertexCount);
+        release(m_FreeIndices, range.firstIndex, range.indexCount);
+    }
+
+    VertexFormat m_Format;
+    size_t m_Stride;
+    size_t m_VertexCapacity = 1 << 16;
+    size_t m_IndexCapacity = 1 << 18;
+    GLuint m_Vao = 0;
+    GLuint m_Vbo = 0;
+    GLuint m_Ebo = 0;
+    std::map<size_t, size_t> m_FreeVertices;    // Offset -> size, in vertices
+    std::map<size_t, size_t> m_FreeIndices;     // Offset -> size, in indices
+    std::set<ArenaRange*> m_Ranges;
+    size_t m_Grows = 0;
+    size_t m_Defragments = 0;
+    size_t m_MappedUploads = 0;     // Meshes written straight into the mapped buffers
+    size_t m_CopiedUploads = 0;     // Meshes copied in from host memory
+};
+
+inline ArenaRange::~ArenaRange()
+{
+    if (arena)
+        arena->release(*this);
+}
+
+#endif // GEOMETRYARENA_H
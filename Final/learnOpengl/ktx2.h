@@ -0,0 +1,208 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The parts of the KTX 2.0 container used for baked textures: one 2D image
+// with a full mip chain of block compressed levels, no supercompression.
+// https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+namespace Ktx2
+{
+    // Vulkan formats of the blocks, as KTX 2.0 names them
+    const std::uint32_t k_FormatBC1 = 131;      // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+    const std::uint32_t k_FormatBC3 = 137;      // VK_FORMAT_BC3_UNORM_BLOCK
+
+    const unsigned char k_Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    struct Header
+    {
+        unsigned char identifier[12];
+        std::uint32_t vkFormat;
+        std::uint32_t typeSize;
+        std::uint32_t pixelWidth;
+        std::uint32_t pixelHeight;
+        std::uint32_t pixelDepth;
+        std::uint32_t layerCount;
+        std::uint32_t faceCount;
+        std::uint32_t levelCount;
+        std::uint32_t supercompressionScheme;
+        std::uint32_t dfdByteOffset;
+        std::uint32_t dfdByteLength;
+        std::uint32_t kvdByteOffset;
+        std::uint32_t kvdByteLength;
+        std::uint64_t sgdByteOffset;
+        std::uint64_t sgdByteLength;
+    };
+
+    struct LevelIndex
+    {
+        std::uint64_t byteOffset;
+        std::uint64_t byteLength;
+        std::uint64_t uncompressedByteLength;
+    };
+
+    // Bytes per 4x4 block of a format
+    inline size_t blockBytes(std::uint32_t vkFormat)
+    {
+        return vkFormat == k_FormatBC1 ? 8 : 16;
+    }
+
+    // One level as stored: full blocks, edges padded
+    inline size_t levelBytes(std::uint32_t vkFormat, int width, int height)
+    {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(vkFormat);
+    }
+
+    // Level of a parsed file, pointing into the file's bytes
+    struct Level
+    {
+        int width;
+        int height;
+        const unsigned char* data;
+        size_t size;
+    };
+
+    // Write levels, finest first, and key/value pairs such as KTXorientation
+    inline bool write(const std::string& path, std::uint32_t vkFormat, int width, int height,
+                      const std::vector<std::vector<unsigned char>>& levels, const std::vector<std::pair<std::string, std::string>>& values)
+    {
+        auto align = [](size_t offset, size_t alignment) { return (offset + alignment - 1) / alignment * alignment; };
+
+        // Basic data format descriptor: BC1 is one 64-bit color sample, BC3 an alpha block then a color block
+        bool bc1 = vkFormat == k_FormatBC1;
+        std::vector<std::uint32_t> dfd;
+        std::uint32_t samples = bc1 ? 1 : 2;
+        std::uint32_t blockSize = 24 + 16 * samples;
+        dfd.push_back(4 + blockSize);                                       // dfdTotalSize
+        dfd.push_back(0);                                                   // Khronos vendor, basic descriptor type
+        dfd.push_back(2 | (blockSize << 16));                               // Version 1.3, block size
+        dfd.push_back((bc1 ? 128u : 130u) | (1u << 8) | (1u << 16));        // BC1A or BC3 model, BT.709 primaries, linear
+        dfd.push_back(3 | (3 << 8));                                        // 4x4 texel blocks
+        dfd.push_back((std::uint32_t)blockBytes(vkFormat));                 // Bytes in plane 0
+        dfd.push_back(0);
+        if (!bc1)
+        {
+            dfd.push_back(0 | (63u << 16) | (15u << 24));                   // Alpha: bits 0-63
+            dfd.push_back(0);
+            dfd.push_back(0);
+            dfd.push_back(0xFFFFFFFF);
+        }
+        dfd.push_back((bc1 ? 0u : 64u) | (63u << 16) | (0u << 24));         // Color: the last 64 bits
+        dfd.push_back(0);
+        dfd.push_back(0);
+        dfd.push_back(0xFFFFFFFF);
+
+        std::vector<unsigned char> kvd;
+        for (const auto& value : values)
+        {
+            std::uint32_t length = (std::uint32_t)(value.first.size() + 1 + value.second.size() + 1);
+            const unsigned char* lengthBytes = (const unsigned char*)&length;
+            kvd.insert(kvd.end(), lengthBytes, lengthBytes + 4);
+            kvd.insert(kvd.end(), value.first.begin(), value.first.end());
+            kvd.push_back(0);
+            kvd.insert(kvd.end(), value.second.begin(), value.second.end());
+            kvd.push_back(0);
+            kvd.resize(align(kvd.size(), 4), 0);
+        }
+
+        Header header = {};
+        std::memcpy(header.identifier, k_Identifier, sizeof(k_Identifier));
+        header.vkFormat = vkFormat;
+        header.typeSize = 1;
+        header.pixelWidth = (std::uint32_t)width;
+        header.pixelHeight = (std::uint32_t)height;
+        header.faceCount = 1;
+        header.levelCount = (std::uint32_t)levels.size();
+        header.dfdByteOffset = (std::uint32_t)(sizeof(Header) + levels.size() * sizeof(LevelIndex));
+        header.dfdByteLength = (std::uint32_t)(dfd.size() * 4);
+        header.kvdByteOffset = kvd.empty() ? 0 : header.dfdByteOffset + header.dfdByteLength;
+        header.kvdByteLength = (std::uint32_t)kvd.size();
+
+        // Levels are stored smallest first, each aligned to its block size
+        std::vector<LevelIndex> index(levels.size());
+        size_t offset = header.dfdByteOffset + header.dfdByteLength + kvd.size();
+        for (size_t i = levels.size(); i-- > 0;)
+        {
+            offset = align(offset, blockBytes(vkFormat));
+            index[i] = { offset, levels[i].size(), levels[i].size() };
+            offset += levels[i].size();
+        }
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)index.data(), index.size() * sizeof(LevelIndex));
+        out.write((const char*)dfd.data(), dfd.size() * 4);
+        out.write((const char*)kvd.data(), kvd.size());
+        size_t written = header.dfdByteOffset + header.dfdByteLength + kvd.size();
+        for (size_t i = levels.size(); i-- > 0;)
+        {
+            static const char zeros[16] = {};
+            out.write(zeros, index[i].byteOffset - written);
+            out.write((const char*)levels[i].data(), levels[i].size());
+            written = index[i].byteOffset + levels[i].size();
+        }
+        return (bool)out.flush();
+    }
+
+    // Value of a key in the key/value data, or empty
+    inline std::string value(const unsigned char* bytes, size_t size, const Header& header, const char* key)
+    {
+        size_t offset = header.kvdByteOffset;
+        size_t end = (size_t)header.kvdByteOffset + header.kvdByteLength;
+        if (end > size)
+            return std::string();
+
+        size_t keyLength = std::strlen(key);
+        while (offset + 4 <= end)
+        {
+            std::uint32_t length;
+            std::memcpy(&length, bytes + offset, 4);
+            const char* entry = (const char*)bytes + offset + 4;
+            if (length > end - offset - 4)
+                break;
+            if (length > keyLength + 1 && std::memcmp(entry, key, keyLength + 1) == 0)
+                return std::string(entry + keyLength + 1, strnlen(entry + keyLength + 1, length - keyLength - 1));
+            offset += (4 + length + 3) / 4 * 4;
+        }
+        return std::string();
+    }
+
+    // Check a file is a baked texture this loader handles and find its levels, finest first
+    inline bool parse(const unsigned char* bytes, size_t size, Header& header, std::vector<Level>& levels)
+    {
+        if (size < sizeof(Header))
+            return false;
+        std::memcpy(&header, bytes, sizeof(Header));
+        if (std::memcmp(header.identifier, k_Identifier, sizeof(k_Identifier)) != 0 ||
+            (header.vkFormat != k_FormatBC1 && header.vkFormat != k_FormatBC3) || header.supercompressionScheme != 0 ||
+            header.pixelDepth != 0 || header.layerCount != 0 || header.faceCount != 1 || header.levelCount == 0 || header.levelCount > 32 ||
+            sizeof(Header) + header.levelCount * sizeof(LevelIndex) > size)
+            return false;
+
+        levels.clear();
+        int width = (int)header.pixelWidth;
+        int height = (int)header.pixelHeight;
+        for (std::uint32_t i = 0; i < header.levelCount; ++i)
+        {
+            LevelIndex index;
+            std::memcpy(&index, bytes + sizeof(Header) + i * sizeof(LevelIndex), sizeof(LevelIndex));
+            if (index.byteLength != levelBytes(header.vkFormat, width, height) || index.byteOffset > size || index.byteLength > size - index.byteOffset)
+                return false;
+
+            levels.push_back({ width, height, bytes + index.byteOffset, (size_t)index.byteLength });
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+        return true;
+    }
+}
+
+#endif // KTX2_H
@@ -0,0 +1,128 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file, or a view of part of another mapping
+class MappedFile
+{
+public:
+    ~MappedFile()
+    {
+        // Views leave the mapping to their parent
+        if (m_Parent)
+            return;
+#ifdef _WIN32
+        if (m_Data)
+            UnmapViewOfFile(m_Data);
+        if (m_Mapping)
+            CloseHandle(m_Mapping);
+        if (m_File != INVALID_HANDLE_VALUE)
+            CloseHandle(m_File);
+#else
+        if (m_Data)
+            munmap((void*)m_Data, m_Size);
+#endif
+    }
+
+    // Map a file, or return nullptr if it is missing or empty
+    static std::shared_ptr<MappedFile> open(const std::string& path)
+    {
+        std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+        file->m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file->m_File == INVALID_HANDLE_VALUE)
+            return nullptr;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file->m_File, &size) || size.QuadPart == 0)
+            return nullptr;
+
+        file->m_Mapping = CreateFileMappingA(file->m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!file->m_Mapping)
+            return nullptr;
+
+        file->m_Data = (const unsigned char*)MapViewOfFile(file->m_Mapping, FILE_MAP_READ, 0, 0, 0);
+        file->m_Size = (size_t)size.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);  // The mapping keeps the file alive
+        if (data == MAP_FAILED)
+            return nullptr;
+
+        file->m_Data = (const unsigned char*)data;
+        file->m_Size = (size_t)info.st_size;
+#endif
+        return file->m_Data ? file : nullptr;
+    }
+
+    // Bytes [offset, offset + size) of a mapping, which the view keeps alive; nullptr if out of range
+    static std::shared_ptr<MappedFile> view(const std::shared_ptr<const MappedFile>& parent, size_t offset, size_t size)
+    {
+        if (!parent || size == 0 || offset > parent->size() || size > parent->size() - offset)
+            return nullptr;
+
+        std::shared_ptr<MappedFile> file(new MappedFile());
+        file->m_Parent = parent;
+        file->m_Data = parent->data() + offset;
+        file->m_Size = size;
+        return file;
+    }
+
+    // Ask the OS to start reading the whole mapping in, so later page faults find it cached
+    void prefetch() const
+    {
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+        WIN32_MEMORY_RANGE_ENTRY range = { (PVOID)m_Data, m_Size };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+        madvise((void*)m_Data, m_Size, MADV_WILLNEED);
+#endif
+    }
+
+    const unsigned char* data() const { return m_Data; }
+    size_t size() const { return m_Size; }
+
+private:
+    MappedFile() { }
+
+    const unsigned char* m_Data = nullptr;
+    size_t m_Size = 0;
+    std::shared_ptr<const MappedFile> m_Parent;     // Set for views
+#ifdef _WIN32
+    HANDLE m_File = INVALID_HANDLE_VALUE;
+    HANDLE m_Mapping = NULL;
+#endif
+};
+
+#endif // MAPPEDFILE_H
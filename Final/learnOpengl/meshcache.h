@@ -0,0 +1,196 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+#include <direct.h>         // _mkdir
+#else
+#include <sys/stat.h>       // mkdir
+#endif
+
+#include "assetarchive.h"   // Meshes shipped in the archive, and MappedFile
+#include "tessellation.h"
+
+// Procedural meshes saved to disk after the first launch. Each mesh is one file
+// holding a header, the final interleaved vertices and indices and the cull
+// clusters, so a cached mesh is memory mapped and uploaded without parsing or
+// copying. A file from another version, with another layout or a bad checksum is
+// regenerated and rewritten.
+class MeshCache
+{
+public:
+    // Bump whenever the output of a generator or MeshOptimizer changes
+    static const std::uint32_t k_Version = 5;
+
+    struct Header
+    {
+        char magic[4];                  // "MESH"
+        std::uint32_t version;
+        std::uint32_t headerSize;
+        std::uint32_t floatsPerVertex;  // Layout: position 3, normal 3, UV 2
+        std::uint32_t indexSize;        // Bytes per index
+        std::uint32_t checksum;         // checksum() of everything after the header
+        std::uint32_t topology;         // Tessellation::Topology of the indices
+        std::uint32_t reserved;
+        std::uint64_t vertexOffset;
+        std::uint64_t vertexBytes;
+        std::uint64_t indexOffset;
+        std::uint64_t indexCount;
+        std::uint64_t clusterOffset;    // Tessellation::Cluster table, after the indices
+        std::uint64_t clusterCount;
+    };
+
+    static bool& enabled()
+    {
+        static bool s_Enabled = true;
+        return s_Enabled;
+    }
+
+    static std::string& directory()
+    {
+        static std::string s_Directory = "./cache";
+        return s_Directory;
+    }
+
+    // Cached mesh for a name, or nullptr if there is no valid cache file
+    static std::shared_ptr<const Tessellation::MeshData> load(const std::string& name)
+    {
+        if (!enabled())
+            return nullptr;
+
+        // A mesh shipped in the archive, unless it is stale and a fresh one was written since
+        std::shared_ptr<const Tessellation::MeshData> data = parse(name, AssetArchive::find(path(name)));
+        return data ? data : parse(name, MappedFile::open(path(name)));
+    }
+
+    // Write a mesh for later launches; failures only cost the next launch a regeneration
+    static void store(const std::string& name, const Tessellation::MeshData& data)
+    {
+        if (!enabled())
+            return;
+
+        makeDirectory(directory());
+
+        Header header = {};
+        std::memcpy(header.magic, "MESH", 4);
+        header.version = k_Version;
+        header.headerSize = sizeof(Header);
+        header.floatsPerVertex = Tessellation::k_FloatsPerVertex;
+        header.indexSize = sizeof(std::uint32_t);
+        header.topology = (std::uint32_t)data.topology;
+        header.vertexOffset = (sizeof(Header) + 15) / 16 * 16;
+        header.vertexBytes = data.vertexBytes;
+        header.indexOffset = header.vertexOffset + data.vertexBytes;
+        header.indexCount = data.indexCount;
+        header.clusterOffset = header.indexOffset + data.indexCount * sizeof(std::uint32_t);
+        header.clusterCount = data.clusterCount;
+
+        const size_t padding = (size_t)header.vertexOffset - sizeof(Header);
+        const char zeros[16] = {};
+        std::uint32_t hash = checksum((const unsigned char*)zeros, padding);
+        hash = checksum((const unsigned char*)data.vertices, data.vertexBytes, hash);
+        hash = checksum((const unsigned char*)data.indices, data.indexCount * sizeof(std::uint32_t), hash);
+        hash = checksum((const unsigned char*)data.clusters, data.clusterCount * sizeof(Tessellation::Cluster), hash);
+        header.checksum = hash;
+
+        // Write beside the final name and swap it in, so a crash never leaves a half file
+        std::string finalPath = path(name);
+        std::string tempPath = finalPath + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            out.write((const char*)&header, sizeof(Header));
+            out.write(zeros, padding);
+            out.write((const char*)data.vertices, data.vertexBytes);
+            out.write((const char*)data.indices, data.indexCount * sizeof(std::uint32_t));
+            out.write((const char*)data.clusters, data.clusterCount * sizeof(Tessellation::Cluster));
+            if (!out)
+            {
+                std::cout << "WARNING: Could not write mesh cache " << tempPath << std::endl;
+                return;
+            }
+        }
+
+        std::remove(finalPath.c_str());
+        if (std::rename(tempPath.c_str(), finalPath.c_str()) != 0)
+            std::cout << "WARNING: Could not write mesh cache " << finalPath << std::endl;
+    }
+
+    // FNV-1a over 32-bit words (every section is a multiple of 4 bytes), continued from a previous hash
+    static std::uint32_t checksum(const unsigned char* bytes, size_t size, std::uint32_t hash = 2166136261u)
+    {
+        for (size_t i = 0; i + 4 <= size; i += 4)
+        {
+            std::uint32_t word;
+            std::memcpy(&word, bytes + i, 4);
+            hash ^= word;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+private:
+    static std::string path(const std::string& name)
+    {
+        return directory() + "/" + name + ".mesh";
+    }
+
+    // Validate a cache file and point mesh data into it; nullptr if missing or stale
+    static std::shared_ptr<const Tessellation::MeshData> parse(const std::string& name, const std::shared_ptr<MappedFile>& file)
+    {
+        if (!file)
+            return nullptr;
+
+        const unsigned char* bytes = file->data();
+        Header header;
+        if (file->size() < sizeof(Header))
+            return reject(name, "truncated");
+        std::memcpy(&header, bytes, sizeof(Header));
+
+        if (std::memcmp(header.magic, "MESH", 4) != 0 || header.version != k_Version || header.headerSize != sizeof(Header))
+            return reject(name, "old version");
+        if (header.floatsPerVertex != Tessellation::k_FloatsPerVertex || header.indexSize != sizeof(std::uint32_t) ||
+            header.topology > (std::uint32_t)Tessellation::Topology::Strips)
+            return reject(name, "different layout");
+        if (header.vertexOffset % 16 != 0 || header.indexOffset < header.vertexOffset + header.vertexBytes ||
+            header.clusterOffset != header.indexOffset + header.indexCount * sizeof(std::uint32_t) ||
+            header.clusterOffset + header.clusterCount * sizeof(Tessellation::Cluster) != file->size())
+            return reject(name, "bad offsets");
+        if (checksum(bytes + sizeof(Header), file->size() - sizeof(Header)) != header.checksum)
+            return reject(name, "checksum mismatch");
+
+        auto data = std::make_shared<Tessellation::MeshData>();
+        data->vertices = (const float*)(bytes + header.vertexOffset);
+        data->vertexBytes = (size_t)header.vertexBytes;
+        data->indices = (const std::uint32_t*)(bytes + header.indexOffset);
+        data->indexCount = (size_t)header.indexCount;
+        data->topology = (Tessellation::Topology)header.topology;
+        data->clusters = (const Tessellation::Cluster*)(bytes + header.clusterOffset);
+        data->clusterCount = (size_t)header.clusterCount;
+        data->storage = file;
+        return data;
+    }
+
+    static std::shared_ptr<const Tessellation::MeshData> reject(const std::string& name, const char* reason)
+    {
+        std::cout << "INFO: Mesh cache " << name << " is stale (" << reason << "), regenerating" << std::endl;
+        return nullptr;
+    }
+
+    static void makeDirectory(const std::string& dir)
+    {
+#ifdef _WIN32
+        _mkdir(dir.c_str());
+#else
+        mkdir(dir.c_str(), 0755);
+#endif
+    }
+};
+
+#endif // MESHCACHE_H
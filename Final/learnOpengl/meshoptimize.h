@@ -0,0 +1,526 @@
+#ifndef MESHOPTIMIZE_H
+#define MESHOPTIMIZE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "tessellation.h"
+
+// Post-processing for generated (or imported) geometry before it is uploaded:
+// weld duplicate vertices, order triangles for the post-transform vertex cache
+// (Tipsify, Sander et al. 2007), order clusters of triangles outside-in to cut
+// overdraw, renumber vertices in the order the GPU fetches them, and split
+// large meshes into clusters that can be culled one by one.
+namespace MeshOptimizer
+{
+    // Post-transform cache modeled by Tipsify and the statistics (FIFO, typical of current GPUs)
+    const std::uint32_t k_CacheSize = 16;
+
+    // How much worse than the whole mesh a cluster's ACMR may be for it to be split for overdraw
+    const float k_OverdrawThreshold = 1.05f;
+
+    // Triangles per cull cluster, and the fewest clusters worth splitting a mesh into
+    const std::size_t k_ClusterTriangles = 96;
+    const std::size_t k_MinClusters = 8;
+
+    struct CacheStats
+    {
+        float acmr = 0.0f;  // Average cache miss ratio: vertices transformed per triangle (0.5 ideal, 3 worst)
+        float atvr = 0.0f;  // Average transformed to vertex ratio: vertices transformed per vertex (1 ideal)
+    };
+
+    struct Report
+    {
+        std::size_t verticesBefore = 0;
+        std::size_t verticesAfter = 0;
+        CacheStats before;
+        CacheStats after;
+    };
+
+    // Vertices transformed by a FIFO cache of the given size. Timestamps only
+    // advance on misses, so a vertex is cached while fewer than cacheSize misses
+    // have happened since it was loaded.
+    inline CacheStats analyzeVertexCache(const std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount,
+                                         std::uint32_t cacheSize = k_CacheSize)
+    {
+        std::vector<std::uint32_t> timestamps(vertexCount, 0);
+        std::vector<bool> used(vertexCount, false);
+        std::uint32_t time = cacheSize + 1;
+        std::size_t misses = 0;
+        std::size_t usedVertices = 0;
+
+        for (std::size_t i = 0; i < indexCount; ++i)
+        {
+            std::uint32_t v = indices[i];
+            if (time - timestamps[v] > cacheSize)
+            {
+                timestamps[v] = time++;
+                ++misses;
+            }
+            if (!used[v])
+            {
+                used[v] = true;
+                ++usedVertices;
+            }
+        }
+
+        CacheStats stats;
+        if (indexCount > 0)
+        {
+            stats.acmr = (float)misses / (indexCount / 3);
+            stats.atvr = (float)misses / usedVertices;
+        }
+        return stats;
+    }
+
+    // Merge vertices with identical attributes, turning a triangle soup (no
+    // indices) into an indexed mesh as well
+    inline void weld(std::vector<float>& vertices, std::vector<std::uint32_t>& indices)
+    {
+        const std::size_t stride = Tessellation::k_FloatsPerVertex;
+        const std::size_t vertexCount = vertices.size() / stride;
+        if (indices.empty())
+        {
+            indices.resize(vertexCount);
+            std::iota(indices.begin(), indices.end(), 0u);
+        }
+
+        // -0 and +0 compare equal, so hash and compare the bits with the sign of zeros cleared
+        auto key = [&](std::size_t v, std::size_t i)
+        {
+            float value = vertices[v * stride + i];
+            std::uint32_t bits;
+            std::memcpy(&bits, &value, 4);
+            return value == 0.0f ? 0u : bits;
+        };
+        auto hash = [&](std::size_t v)
+        {
+            std::uint32_t h = 2166136261u;
+            for (std::size_t i = 0; i < stride; ++i)
+            {
+                h = (h ^ key(v, i)) * 16777619u;
+            }
+            return h;
+        };
+        auto equal = [&](std::size_t a, std::size_t b)
+        {
+            for (std::size_t i = 0; i < stride; ++i)
+            {
+                if (key(a, i) != key(b, i))
+                    return false;
+            }
+            return true;
+        };
+
+        // Open addressing table of unique vertex numbers + 1, at most half full
+        std::size_t tableSize = 1;
+        while (tableSize < vertexCount * 2)
+            tableSize *= 2;
+        std::vector<std::uint32_t> table(tableSize, 0);
+
+        std::vector<std::uint32_t> remap(vertexCount);
+        std::vector<float> unique;
+        unique.reserve(vertices.size());
+        for (std::size_t v = 0; v < vertexCount; ++v)
+        {
+            std::size_t slot = hash(v) & (tableSize - 1);
+            while (table[slot] != 0 && !equal(v, table[slot] - 1))
+                slot = (slot + 1) & (tableSize - 1);
+
+            if (table[slot] == 0)
+            {
+                // First time this vertex is seen; its original index stands in for it in the table
+                table[slot] = (std::uint32_t)v + 1;
+                remap[v] = (std::uint32_t)(unique.size() / stride);
+                unique.insert(unique.end(), vertices.begin() + v * stride, vertices.begin() + (v + 1) * stride);
+            }
+            else
+            {
+                remap[v] = remap[table[slot] - 1];
+            }
+        }
+
+        for (std::uint32_t& index : indices)
+        {
+            index = remap[index];
+        }
+        vertices.swap(unique);
+    }
+
+    // Reorder triangles for the vertex cache with Tipsify. Returns the first
+    // triangle of every hard boundary, where the walk hit a dead end and jumped
+    // to an unrelated part of the mesh.
+    inline std::vector<std::size_t> optimizeVertexCache(std::vector<std::uint32_t>& indices, std::size_t vertexCount,
+                                                        std::uint32_t cacheSize = k_CacheSize)
+    {
+        const std::size_t triangleCount = indices.size() / 3;
+
+        // Triangles using each vertex
+        std::vector<std::uint32_t> live(vertexCount, 0);
+        for (std::uint32_t index : indices)
+        {
+            ++live[index];
+        }
+        std::vector<std::size_t> offsets(vertexCount + 1, 0);
+        for (std::size_t v = 0; v < vertexCount; ++v)
+        {
+            offsets[v + 1] = offsets[v] + live[v];
+        }
+        std::vector<std::uint32_t> adjacency(indices.size());
+        std::vector<std::size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (std::size_t t = 0; t < triangleCount; ++t)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                adjacency[fill[indices[t * 3 + k]]++] = (std::uint32_t)t;
+            }
+        }
+
+        std::vector<std::uint32_t> timestamps(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<std::uint32_t> deadEnd;
+        std::vector<std::uint32_t> candidates;
+        std::vector<std::uint32_t> result;
+        std::vector<std::size_t> boundaries;
+        result.reserve(indices.size());
+        std::uint32_t time = cacheSize + 1;
+        std::size_t cursor = 0;
+
+        // Most recently used vertex with triangles left, then any vertex in input order
+        auto skipDeadEnd = [&]() -> std::int64_t
+        {
+            while (!deadEnd.empty())
+            {
+                std::uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0)
+                    return v;
+            }
+            for (; cursor < vertexCount; ++cursor)
+            {
+                if (live[cursor] > 0)
+                    return (std::int64_t)cursor;
+            }
+            return -1;
+        };
+
+        std::int64_t fan = skipDeadEnd();
+        bool jumped = true;
+        while (fan >= 0)
+        {
+            if (jumped)
+                boundaries.push_back(result.size() / 3);
+
+            // Emit every remaining triangle around the fanning vertex
+            candidates.clear();
+            for (std::size_t a = offsets[fan]; a < offsets[fan + 1]; ++a)
+            {
+                std::uint32_t t = adjacency[a];
+                if (emitted[t])
+                    continue;
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    std::uint32_t v = indices[t * 3 + k];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    if (time - timestamps[v] > cacheSize)
+                        timestamps[v] = time++;
+                }
+                emitted[t] = true;
+            }
+
+            // Next fan: the candidate that stays in the cache through its own remaining triangles and has been there longest
+            std::int64_t best = -1;
+            std::int64_t bestPriority = -1;
+            for (std::uint32_t v : candidates)
+            {
+                if (live[v] == 0)
+                    continue;
+
+                std::int64_t priority = 0;
+                if (time - timestamps[v] + 2 * live[v] <= cacheSize)
+                    priority = time - timestamps[v];
+                if (priority > bestPriority)
+                {
+                    best = v;
+                    bestPriority = priority;
+                }
+            }
+
+            jumped = best < 0;
+            fan = jumped ? skipDeadEnd() : best;
+        }
+
+        indices.swap(result);
+        return boundaries;
+    }
+
+    // Reorder the clusters between boundaries so triangles facing out from the
+    // mesh centre are drawn first and hide the rest through the depth test.
+    // Hard clusters are split further where that costs little cache efficiency.
+    inline void optimizeOverdraw(std::vector<std::uint32_t>& indices, const std::vector<float>& vertices,
+                                 const std::vector<std::size_t>& hardBoundaries, float threshold = k_OverdrawThreshold,
+                                 std::uint32_t cacheSize = k_CacheSize)
+    {
+        const std::size_t stride = Tessellation::k_FloatsPerVertex;
+        const std::size_t vertexCount = vertices.size() / stride;
+        const std::size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        const float meshAcmr = analyzeVertexCache(indices.data(), indices.size(), vertexCount, cacheSize).acmr;
+
+        // Soft boundaries: a triangle missing all three vertices starts a new patch,
+        // so splitting there is nearly free once the cluster so far is efficient enough
+        std::vector<std::size_t> clusters;
+        std::vector<std::uint32_t> timestamps(vertexCount, 0);
+        std::uint32_t time = cacheSize + 1;
+        for (std::size_t c = 0; c < hardBoundaries.size(); ++c)
+        {
+            std::size_t start = hardBoundaries[c];
+            std::size_t end = c + 1 < hardBoundaries.size() ? hardBoundaries[c + 1] : triangleCount;
+
+            time += cacheSize + 1;  // Cold cache at every hard boundary
+            std::size_t clusterStart = start;
+            std::size_t clusterMisses = 0;
+            for (std::size_t t = start; t < end; ++t)
+            {
+                std::size_t misses = 0;
+                for (int k = 0; k < 3; ++k)
+                {
+                    std::uint32_t v = indices[t * 3 + k];
+                    if (time - timestamps[v] > cacheSize)
+                    {
+                        timestamps[v] = time++;
+                        ++misses;
+                    }
+                }
+
+                if (t == start || (misses == 3 && clusterMisses <= threshold * meshAcmr * (t - clusterStart)))
+                {
+                    clusters.push_back(t);
+                    clusterStart = t;
+                    clusterMisses = 0;
+                }
+                clusterMisses += misses;
+            }
+        }
+
+        // Area weighted centroid of the mesh
+        auto position = [&](std::uint32_t v, int axis) { return vertices[v * stride + axis]; };
+        float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+        float meshArea = 0.0f;
+        std::vector<float> areas(triangleCount);
+        std::vector<float> normals(triangleCount * 3);
+        for (std::size_t t = 0; t < triangleCount; ++t)
+        {
+            std::uint32_t a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+            float e1[3], e2[3];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                e1[axis] = position(b, axis) - position(a, axis);
+                e2[axis] = position(c, axis) - position(a, axis);
+            }
+            float* n = &normals[t * 3];
+            n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+            n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+            n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+            areas[t] = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                meshCentroid[axis] += areas[t] * (position(a, axis) + position(b, axis) + position(c, axis)) / 3.0f;
+            }
+            meshArea += areas[t];
+        }
+        for (float& axis : meshCentroid)
+        {
+            axis = meshArea > 0.0f ? axis / meshArea : 0.0f;
+        }
+
+        // How far each cluster faces away from the centre
+        std::vector<float> sortKeys(clusters.size());
+        for (std::size_t c = 0; c < clusters.size(); ++c)
+        {
+            std::size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            float centroid[3] = { 0.0f, 0.0f, 0.0f };
+            float normal[3] = { 0.0f, 0.0f, 0.0f };
+            float area = 0.0f;
+            for (std::size_t t = clusters[c]; t < end; ++t)
+            {
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    float corners = position(indices[t * 3], axis) + position(indices[t * 3 + 1], axis) + position(indices[t * 3 + 2], axis);
+                    centroid[axis] += areas[t] * corners / 3.0f;
+                    normal[axis] += normals[t * 3 + axis];
+                }
+                area += areas[t];
+            }
+
+            float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            float key = 0.0f;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                float offset = area > 0.0f ? centroid[axis] / area - meshCentroid[axis] : 0.0f;
+                key += offset * (length > 0.0f ? normal[axis] / length : 0.0f);
+            }
+            sortKeys[c] = key;
+        }
+
+        std::vector<std::size_t> order(clusters.size());
+        std::iota(order.begin(), order.end(), (std::size_t)0);
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+        std::vector<std::uint32_t> result;
+        result.reserve(indices.size());
+        for (std::size_t c : order)
+        {
+            std::size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+        }
+        indices.swap(result);
+    }
+
+    // Renumber vertices in first use order so the vertex fetch walks memory
+    // forward; vertices no triangle uses are dropped
+    inline void optimizeVertexFetch(std::vector<float>& vertices, std::vector<std::uint32_t>& indices)
+    {
+        const std::size_t stride = Tessellation::k_FloatsPerVertex;
+        const std::uint32_t unused = ~0u;
+        std::vector<std::uint32_t> remap(vertices.size() / stride, unused);
+        std::vector<float> ordered;
+        ordered.reserve(vertices.size());
+
+        for (std::uint32_t& index : indices)
+        {
+            if (remap[index] == unused)
+            {
+                remap[index] = (std::uint32_t)(ordered.size() / stride);
+                ordered.insert(ordered.end(), vertices.begin() + index * stride, vertices.begin() + (index + 1) * stride);
+            }
+            index = remap[index];
+        }
+        vertices.swap(ordered);
+    }
+
+    // Cut the index buffer into runs of k_ClusterTriangles and bound each one. The
+    // vertex cache order is already spatially coherent, so the runs are compact
+    // patches. The cone test is the one from meshoptimizer (Kapoulkine): a cluster
+    // faces away when dot(center - eye, axis) >= cutoff * |center - eye| + radius.
+    inline std::vector<Tessellation::Cluster> buildClusters(const std::vector<float>& vertices, const std::vector<std::uint32_t>& indices)
+    {
+        const std::size_t stride = Tessellation::k_FloatsPerVertex;
+        const std::size_t triangleCount = indices.size() / 3;
+
+        std::vector<Tessellation::Cluster> clusters;
+        for (std::size_t first = 0; first < triangleCount; first += k_ClusterTriangles)
+        {
+            const std::size_t last = std::min(triangleCount, first + k_ClusterTriangles);
+            Tessellation::Cluster cluster = {};
+            cluster.firstIndex = (std::uint32_t)(first * 3);
+            cluster.indexCount = (std::uint32_t)((last - first) * 3);
+
+            // Sphere around the centroid of the corners
+            double centroid[3] = { 0.0, 0.0, 0.0 };
+            for (std::size_t i = first * 3; i < last * 3; ++i)
+            {
+                for (int axis = 0; axis < 3; ++axis)
+                    centroid[axis] += vertices[indices[i] * stride + axis];
+            }
+            for (int axis = 0; axis < 3; ++axis)
+                cluster.center[axis] = (float)(centroid[axis] / (cluster.indexCount));
+
+            // Face normals; degenerate triangles (sphere poles) face nowhere and are left out
+            std::vector<float> normals;
+            float axisSum[3] = { 0.0f, 0.0f, 0.0f };
+            for (std::size_t t = first; t < last; ++t)
+            {
+                const float* p[3];
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    p[corner] = &vertices[indices[t * 3 + corner] * stride];
+                    float dx = p[corner][0] - cluster.center[0];
+                    float dy = p[corner][1] - cluster.center[1];
+                    float dz = p[corner][2] - cluster.center[2];
+                    cluster.radius = std::max(cluster.radius, std::sqrt(dx * dx + dy * dy + dz * dz));
+                }
+
+                float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+                float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+                float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (length <= 1e-12f)
+                    continue;
+
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    normals.push_back(n[axis] / length);
+                    axisSum[axis] += n[axis] / length;
+                }
+            }
+
+            // The cone is useless once the normals spread to near 90 degrees from the axis
+            float length = std::sqrt(axisSum[0] * axisSum[0] + axisSum[1] * axisSum[1] + axisSum[2] * axisSum[2]);
+            float minDot = 1.0f;
+            for (int axis = 0; axis < 3; ++axis)
+                cluster.coneAxis[axis] = length > 0.0f ? axisSum[axis] / length : 0.0f;
+            for (std::size_t n = 0; n < normals.size(); n += 3)
+            {
+                minDot = std::min(minDot, normals[n] * cluster.coneAxis[0] + normals[n + 1] * cluster.coneAxis[1] + normals[n + 2] * cluster.coneAxis[2]);
+            }
+            cluster.coneCutoff = (length <= 0.0f || minDot <= 0.1f) ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+
+            clusters.push_back(cluster);
+        }
+        return clusters;
+    }
+
+    // Run the whole pipeline on a mesh
+    inline Report optimize(Tessellation::Geometry& geometry)
+    {
+        const std::size_t stride = Tessellation::k_FloatsPerVertex;
+
+        Report report;
+        report.verticesBefore = geometry.vertices.size() / stride;
+        if (geometry.indices.empty())
+        {
+            // Unindexed soup: every vertex is transformed once per triangle corner
+            report.before.acmr = 3.0f;
+            report.before.atvr = 1.0f;
+        }
+        else
+        {
+            report.before = analyzeVertexCache(geometry.indices.data(), geometry.indices.size(), report.verticesBefore);
+        }
+
+        weld(geometry.vertices, geometry.indices);
+        std::vector<std::size_t> boundaries = optimizeVertexCache(geometry.indices, geometry.vertices.size() / stride);
+        optimizeOverdraw(geometry.indices, geometry.vertices, boundaries);
+        optimizeVertexFetch(geometry.vertices, geometry.indices);
+
+        report.verticesAfter = geometry.vertices.size() / stride;
+        report.after = analyzeVertexCache(geometry.indices.data(), geometry.indices.size(), report.verticesAfter);
+
+        geometry.clusters.clear();
+        if (geometry.indices.size() / 3 >= k_ClusterTriangles * k_MinClusters)
+            geometry.clusters = buildClusters(geometry.vertices, geometry.indices);
+        return report;
+    }
+
+    // Optimized copy of geometry that is already shared
+    inline Report optimize(const Tessellation::MeshData& data, Tessellation::Geometry& geometry)
+    {
+        geometry.vertices.assign(data.vertices, data.vertices + data.vertexBytes / sizeof(float));
+        geometry.indices.assign(data.indices, data.indices + data.indexCount);
+        return optimize(geometry);
+    }
+}
+
+#endif // MESHOPTIMIZE_H
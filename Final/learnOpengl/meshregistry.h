@@ -0,0 +1,357 @@
+#ifndef MESHREGISTRY_H
+#define MESHREGISTRY_H
+
+#include "object.h"
+#include "meshcache.h"
+#include "meshoptimize.h"
+#include <cstdio>
+#include <sstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <tuple>
+
+// Hands out shared meshes keyed by primitive type and parameters, so identical
+// primitives are generated and uploaded once no matter how many objects use them.
+// Entries are weak: a mesh is freed when the last object holding it goes away.
+//
+// Loading is split like Object::load()/upload(): generate*() builds the CPU
+// geometry on any thread (concurrent requests for the same key share one build),
+// and upload() turns it into a GLMesh on the context thread. A key whose mesh is
+// already uploaded is not built again: its request carries no geometry, only a
+// way to build it should the mesh be released before the request is uploaded.
+class MeshRegistry
+{
+public:
+    enum class Primitive { Sphere, Cylinder, Cone };
+
+    struct Key
+    {
+        Primitive type;
+        float radius;
+        float height;
+        std::uint32_t stacks;
+        std::uint32_t sectors;
+        Tessellation::Topology topology;
+
+        bool operator<(const Key& other) const
+        {
+            return std::tie(type, radius, height, stacks, sectors, topology) <
+                   std::tie(other.type, other.radius, other.height, other.stacks, other.sectors, other.topology);
+        }
+    };
+
+    // Geometry generated for a key, waiting for upload()
+    struct Request
+    {
+        Key key;
+        std::shared_ptr<const Tessellation::MeshData> data;     // nullptr if the mesh was live when requested
+        std::function<Request()> regenerate;                    // Builds the geometry after all, for requests without it
+    };
+
+    // Strips come from the runtime builders, as the compile-time ones only make triangle lists
+    template <std::uint32_t Stacks, std::uint32_t Sectors>
+    static Request generateSphere(float radius, Tessellation::Topology topology = defaultTopology())
+    {
+        if (topology == Tessellation::Topology::Strips)
+            return generateSphere(radius, Stacks, Sectors, topology);
+        return generate({ Primitive::Sphere, radius, 0.0f, Stacks, Sectors, topology }, [=] { return Tessellation::share(Tessellation::buildSphere<Stacks, Sectors>(radius)); });
+    }
+
+    static Request generateSphere(float radius, std::uint32_t stacks, std::uint32_t sectors, Tessellation::Topology topology = defaultTopology())
+    {
+        return generate({ Primitive::Sphere, radius, 0.0f, stacks, sectors, topology }, [=]
+        {
+            return Tessellation::share(topology == Tessellation::Topology::Strips ? Tessellation::buildSphereStrips(radius, stacks, sectors)
+                                                                                 : Tessellation::buildSphere(radius, stacks, sectors));
+        });
+    }
+
+    template <std::uint32_t NumSectors>
+    static Request generateCylinder(float radius, float height, Tessellation::Topology topology = defaultTopology())
+    {
+        if (topology == Tessellation::Topology::Strips)
+            return generateCylinder(radius, height, NumSectors, topology);
+        return generate({ Primitive::Cylinder, radius, height, 0, NumSectors, topology }, [=] { return Tessellation::share(Tessellation::buildCylinder<NumSectors>(radius, height)); });
+    }
+
+    static Request generateCylinder(float radius, float height, std::uint32_t numSectors = 16, Tessellation::Topology topology = defaultTopology())
+    {
+        return generate({ Primitive::Cylinder, radius, height, 0, numSectors, topology }, [=]
+        {
+            return Tessellation::share(topology == Tessellation::Topology::Strips ? Tessellation::buildCylinderStrips(radius, height, numSectors)
+                                                                                 : Tessellation::buildCylinder(radius, height, numSectors));
+        });
+    }
+
+    template <std::uint32_t NumSectors>
+    static Request generateCone(float radius, float height, Tessellation::Topology topology = defaultTopology())
+    {
+        if (topology == Tessellation::Topology::Strips)
+            return generateCone(radius, height, NumSectors, topology);
+        return generate({ Primitive::Cone, radius, height, 0, NumSectors, topology }, [=] { return Tessellation::share(Tessellation::buildCone<NumSectors>(radius, height)); });
+    }
+
+    static Request generateCone(float radius, float height, std::uint32_t numSectors = 16, Tessellation::Topology topology = defaultTopology())
+    {
+        return generate({ Primitive::Cone, radius, height, 0, numSectors, topology }, [=]
+        {
+            return Tessellation::share(topology == Tessellation::Topology::Strips ? Tessellation::buildConeStrips(radius, height, numSectors)
+                                                                                 : Tessellation::buildCone(radius, height, numSectors));
+        });
+    }
+
+    // Live mesh for the request's key, uploading its geometry if there is none
+    static MeshHandle upload(const Request& request)
+    {
+        std::weak_ptr<GLMesh>& entry = entries()[request.key];
+        MeshHandle mesh = entry.lock();
+        if (mesh)
+        {
+            ++stats().hits;
+            if (gReportMeshMemory)
+                std::cout << "INFO: Mesh at vertex " << mesh->range->baseVertex << " shared, " << mesh.use_count() << " users" << std::endl;
+            return mesh;
+        }
+
+        // The mesh the request was counting on has been released since
+        if (!request.data)
+        {
+            if (!request.regenerate)
+            {
+                std::cout << "WARNING: Mesh " << cacheName(request.key) << " was released before its request was uploaded" << std::endl;
+                return nullptr;
+            }
+            return upload(request.regenerate());
+        }
+
+        ++stats().misses;
+        GLMesh created;
+        Object::createMesh(*request.data, created, vertexFormat());
+
+        // Until the last handle goes, later requests for the key skip building it
+        Key key = request.key;
+        mesh = MeshHandle(new GLMesh(created), [key](GLMesh* released)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex());
+                uploaded().erase(key);
+            }
+            delete released;
+        });
+        entry = mesh;
+
+        // Later requests find the GL mesh, so the CPU copy is no longer needed
+        std::lock_guard<std::mutex> lock(mutex());
+        pending().erase(request.key);
+        uploaded().insert(request.key);
+        return mesh;
+    }
+
+    // Upload requests for one primitive, finest first, as a LOD chain
+    static LodChain uploadLod(const std::vector<Request>& requests)
+    {
+        LodChain chain;
+        std::vector<std::uint32_t> sectors;
+        for (const Request& request : requests)
+        {
+            chain.levels.push_back(upload(request));
+            sectors.push_back(request.key.sectors);
+        }
+        chain.minPixels = Object::lodThresholds(sectors);
+        return chain;
+    }
+
+    // Synchronous versions for the context thread: generate and upload in one call
+    template <std::uint32_t Stacks, std::uint32_t Sectors>
+    static MeshHandle sphere(float radius)
+    {
+        return acquire({ Primitive::Sphere, radius, 0.0f, Stacks, Sectors, defaultTopology() }, [=] { return generateSphere<Stacks, Sectors>(radius); });
+    }
+
+    static MeshHandle sphere(float radius, std::uint32_t stacks, std::uint32_t sectors)
+    {
+        return acquire({ Primitive::Sphere, radius, 0.0f, stacks, sectors, defaultTopology() }, [=] { return generateSphere(radius, stacks, sectors); });
+    }
+
+    template <std::uint32_t NumSectors>
+    static MeshHandle cylinder(float radius, float height)
+    {
+        return acquire({ Primitive::Cylinder, radius, height, 0, NumSectors, defaultTopology() }, [=] { return generateCylinder<NumSectors>(radius, height); });
+    }
+
+    static MeshHandle cylinder(float radius, float height, std::uint32_t numSectors = 16)
+    {
+        return acquire({ Primitive::Cylinder, radius, height, 0, numSectors, defaultTopology() }, [=] { return generateCylinder(radius, height, numSectors); });
+    }
+
+    template <std::uint32_t NumSectors>
+    static MeshHandle cone(float radius, float height)
+    {
+        return acquire({ Primitive::Cone, radius, height, 0, NumSectors, defaultTopology() }, [=] { return generateCone<NumSectors>(radius, height); });
+    }
+
+    static MeshHandle cone(float radius, float height, std::uint32_t numSectors = 16)
+    {
+        return acquire({ Primitive::Cone, radius, height, 0, numSectors, defaultTopology() }, [=] { return generateCone(radius, height, numSectors); });
+    }
+
+    // Index layout for requests that do not pick one; set before the first request
+    static Tessellation::Topology& defaultTopology()
+    {
+        static Tessellation::Topology s_Topology = Tessellation::Topology::Triangles;
+        return s_Topology;
+    }
+
+    // Vertex layout meshes are uploaded in; set before the first upload
+    static VertexFormat& vertexFormat()
+    {
+        static VertexFormat s_Format = VertexFormat::Quantized;
+        return s_Format;
+    }
+
+    // Lookups that reused a live mesh, and lookups that had to upload one
+    static std::size_t hits() { return stats().hits; }
+    static std::size_t misses() { return stats().misses; }
+
+private:
+    typedef std::shared_future<std::shared_ptr<const Tessellation::MeshData>> PendingGeometry;
+
+    struct Stats
+    {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+    };
+
+    // Build the geometry for a key, or wait for the thread already building it; nothing if the key's mesh is live
+    template <typename Build>
+    static Request generate(const Key& key, Build build)
+    {
+        std::promise<std::shared_ptr<const Tessellation::MeshData>> promise;
+        PendingGeometry geometry;
+        bool builder = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex());
+            if (uploaded().count(key) > 0)
+                return { key, nullptr, [key, build] { return generate(key, build); } };
+
+            auto found = pending().find(key);
+            if (found != pending().end())
+            {
+                geometry = found->second;
+            }
+            else
+            {
+                geometry = promise.get_future().share();
+                pending()[key] = geometry;
+                builder = true;
+            }
+        }
+
+        if (builder)
+        {
+            try
+            {
+                // Prefer the copy on disk from an earlier launch, which is already optimized
+                std::string name = cacheName(key);
+                std::shared_ptr<const Tessellation::MeshData> data = MeshCache::load(name);
+                if (!data)
+                {
+                    // Strips keep their order: the optimizer works on triangle lists
+                    data = build();
+                    if (data->topology == Tessellation::Topology::Triangles)
+                        data = optimize(name, *data);
+                    MeshCache::store(name, *data);
+                }
+                promise.set_value(data);
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+                std::lock_guard<std::mutex> lock(mutex());
+                pending().erase(key);
+            }
+        }
+
+        return { key, geometry.get(), nullptr };
+    }
+
+    // Weld and reorder freshly generated geometry for the GPU
+    static std::shared_ptr<const Tessellation::MeshData> optimize(const std::string& name, const Tessellation::MeshData& data)
+    {
+        Tessellation::Geometry geometry;
+        MeshOptimizer::Report report = MeshOptimizer::optimize(data, geometry);
+
+        if (gReportMeshMemory)
+        {
+            // One write per line, as several workers may be reporting
+            std::ostringstream line;
+            line << "INFO: Optimized mesh " << name << ": " << report.verticesBefore << " -> " << report.verticesAfter
+                 << " vertices, ACMR " << report.before.acmr << " -> " << report.after.acmr
+                 << ", ATVR " << report.before.atvr << " -> " << report.after.atvr << "\n";
+            std::cout << line.str() << std::flush;
+        }
+        return Tessellation::share(std::move(geometry));
+    }
+
+    // File name for a key, with the float parameters spelled out bit for bit
+    static std::string cacheName(const Key& key)
+    {
+        const char* names[] = { "sphere", "cylinder", "cone" };
+        std::uint32_t radius, height;
+        std::memcpy(&radius, &key.radius, 4);
+        std::memcpy(&height, &key.height, 4);
+
+        char name[96];
+        std::snprintf(name, sizeof(name), "%s_%08x_%08x_%u_%u%s", names[(int)key.type], radius, height, key.stacks, key.sectors,
+                      key.topology == Tessellation::Topology::Strips ? "_strips" : "");
+        return name;
+    }
+
+    template <typename Generate>
+    static MeshHandle acquire(const Key& key, Generate generate)
+    {
+        auto found = entries().find(key);
+        if (found != entries().end() && !found->second.expired())
+            return upload({ key, nullptr });
+
+        return upload(generate());
+    }
+
+    // Uploaded meshes; only touched on the context thread
+    static std::map<Key, std::weak_ptr<GLMesh>>& entries()
+    {
+        static std::map<Key, std::weak_ptr<GLMesh>> s_Entries;
+        return s_Entries;
+    }
+
+    // Keys with a live GLMesh, for generate() on the workers, which may not look at entries(); guarded by mutex()
+    static std::set<Key>& uploaded()
+    {
+        static std::set<Key> s_Uploaded;
+        return s_Uploaded;
+    }
+
+    // Geometry generated or being generated, guarded by mutex()
+    static std::map<Key, PendingGeometry>& pending()
+    {
+        static std::map<Key, PendingGeometry> s_Pending;
+        return s_Pending;
+    }
+
+    static std::mutex& mutex()
+    {
+        static std::mutex s_Mutex;
+        return s_Mutex;
+    }
+
+    static Stats& stats()
+    {
+        static Stats s_Stats;
+        return s_Stats;
+    }
+};
+
+#endif // MESHREGISTRY_H
@@ -3,11 +3,24 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <cstddef>
 #include <vector>
+#include <memory>
+#include <future>
+#include <exception>
+#include <algorithm>
+#include <chrono>
+#include <limits>
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>      // Image loading Utility functions
+
+#include "tessellation.h"   // CPU side of the procedural primitives
+#include "threadpool.h"     // Worker threads for the CPU half of initialization
+#include "vertexformat.h"   // Packed vertex layouts
+#include "geometryarena.h"  // Shared vertex and index buffers
+#include "texturecache.h"   // Shared textures
+#include "textureresidency.h"    // Texture memory budget
+#include "shaderprogram.h"  // Uniforms by slot
 
 // GLM Math Header inclusions
 #define GLM_ENABLE_EXPERIMENTAL
@@ -17,36 +30,146 @@
 
 static float k_PI = std::acos(-1.0);
 
+class RenderQueue;
+
+// Print the VBO/EBO sizes of each indexed mesh and the bytes saved over a non-indexed soup
+static bool gReportMeshMemory = false;
+
+// Pick levels of detail from screen size; when off every chain draws its finest level
+static bool gLodEnabled = true;
+
+// Cull the clusters of large meshes against the view frustum and their backface cones
+static bool gClusterCulling = true;
+
+// Longest silhouette edge, in pixels, a coarser level may show before a finer one is used
+static const float k_LodEdgePixels = 8.0f;
+
+// Fraction a threshold must be crossed by before switching level, so objects do not pop back and forth
+static const float k_LodHysteresis = 0.1f;
+
 struct GLMesh
 {
-    GLuint vao;         // Handle for the vertex array object
-    GLuint vbo;         // Handle for the vertex buffer object
+    GLuint vao;         // Handle for the vertex array object, shared by every mesh in the same arena
+    std::shared_ptr<ArenaRange> range;          // Where the vertices and indices are in the arena's buffers
     GLuint vertices;    // Number of vertices of the mesh
     GLuint indices;     // Number of indices of the mesh (optional)
+    GLenum mode = GL_TRIANGLES;                 // GL_TRIANGLE_STRIP for strips joined by primitive restart
+    GLuint triangles = 0;                       // Triangles drawn, for the frame counters
+    VertexFormat format = VertexFormat::Float32;
+    float positionScale = 1.0f;                 // Quantized positions decode to positionOffset + positionScale * position
+    glm::vec3 positionOffset = { 0, 0, 0 };
+    std::vector<Tessellation::Cluster> clusters;    // Cull clusters, in the space of the uploaded positions
+};
+
+// Ref-counted mesh; its arena space is released with the last handle
+typedef std::shared_ptr<GLMesh> MeshHandle;
+
+// Meshes of one primitive from finest to coarsest
+struct LodChain
+{
+    std::vector<MeshHandle> levels;
+    std::vector<float> minPixels;   // Smallest projected radius, in pixels, that keeps level i (all but the last level)
+    size_t current = 0;             // Level drawn last frame
+};
+
+// Counters for the frame being drawn
+struct FrameStats
+{
+    size_t drawCalls = 0;
+    size_t triangles = 0;
+    size_t vaoBinds = 0;
+    size_t trianglesCulled = 0;     // In clusters skipped by drawMesh
 };
 
 class Object
 {
 public:
-    virtual ~Object()
+    // Meshes and textures are handles, released with the object
+    virtual ~Object() { }
+
+    // Initialize textures, vertices, etc.
+    virtual bool initialize()
     {
-        for (auto mesh : m_Meshes)
+        bool loaded = false;
+        try
+        {
+            loaded = load();
+        }
+        catch (const std::exception& e)
         {
-            glDeleteVertexArrays(1, &mesh.vao);
-            glDeleteBuffers(1, &mesh.vbo);
+            std::cout << "WARNING: Object failed to load: " << e.what() << std::endl;
         }
+        return upload() && loaded;
+    }
+
+    // CPU half of initialize(): generate geometry and decode images. Runs on a
+    // worker thread, so it must not call OpenGL.
+    virtual bool load() = 0;
+
+    // GL half of initialize(): upload whatever load() produced, even if it
+    // failed part way. Runs on the context thread.
+    virtual bool upload() = 0;
 
-        for (auto textureId : m_Textures)
+    // Initialize every object, running the loads on the pool and each upload on
+    // this thread as soon as its load finishes
+    static bool initializeAll(const std::vector<Object*>& objects, ThreadPool& pool)
+    {
+        std::vector<std::future<bool>> loads;
+        for (Object* obj : objects)
         {
-            glGenTextures(1, &textureId);
+            loads.push_back(pool.submit([obj] { return obj->load(); }));
         }
+
+        bool success = true;
+        std::vector<size_t> remaining;
+        for (size_t i = 0; i < objects.size(); ++i)
+            remaining.push_back(i);
+
+        while (!remaining.empty())
+        {
+            // Upload whichever loads are done, or block on the oldest if none are
+            auto ready = std::find_if(remaining.begin(), remaining.end(), [&](size_t i)
+            {
+                return loads[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            });
+            if (ready == remaining.end())
+                ready = remaining.begin();
+
+            size_t i = *ready;
+            remaining.erase(ready);
+
+            // A load that threw counts as one that failed; the other loads carry on
+            bool loaded = false;
+            try
+            {
+                loaded = loads[i].get();
+            }
+            catch (const std::exception& e)
+            {
+                std::cout << "WARNING: Object failed to load: " << e.what() << std::endl;
+            }
+            if (!objects[i]->upload() || !loaded)
+                success = false;
+        }
+
+        return success;
     }
 
-    // Initialize textures, vertices, etc.
-    virtual bool initialize() = 0;
+    // Queue the object's draws with the program; nothing is bound or drawn until the queue is submitted
+    virtual void draw(RenderQueue& queue, ShaderProgram& program) = 0;
+
+    // Tell the texture streamer how large the object is on screen, from a sphere around its scaled unit bounds
+    void prioritizeTextures() const
+    {
+        if (!TextureStreamer::enabled())
+            return;
 
-    // Draw
-    virtual void draw(GLint modelHandle) = 0;
+        float pixels = projectedRadius(m_Position, 0.5f * glm::length(m_Scale));
+        for (const TextureHandle& texture : m_Textures)
+        {
+            TextureStreamer::prioritize(texture->id, pixels);
+        }
+    }
 
     // Update based on fps
     virtual void update(float elapsed) = 0;
@@ -70,423 +193,441 @@ public:
     }
 
     // Create simple mesh from vertices
-    static void createMesh(GLfloat verts[], size_t size, GLMesh& mesh)
+    static void createMesh(const GLfloat verts[], size_t size, GLMesh& mesh)
+    {
+        createMesh(verts, size, nullptr, 0, mesh);
+    }
+
+    // Create indexed mesh from vertices and triangle indices, uploaded in the given vertex format
+    static void createMesh(const GLfloat verts[], size_t size, const GLuint indices[], size_t indexCount, GLMesh& mesh,
+                           VertexFormat format = VertexFormat::Float32)
     {
         const GLuint floatsPerVertex = 3;
         const GLuint floatsPerNormal = 3;
         const GLuint floatsPerUV = 2;
 
         mesh.vertices = size / (sizeof(GLfloat) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+        mesh.indices = indexCount;
+        mesh.mode = GL_TRIANGLES;
+        mesh.triangles = (indexCount > 0 ? indexCount : mesh.vertices) / 3;
+        mesh.format = VertexFormat::Float32;
+        mesh.positionScale = 1.0f;
+        mesh.positionOffset = glm::vec3(0.0f);
+
+        // Pack the vertices if asked, keeping floats for anything the packed layout cannot hold
+        float positionScale = 1.0f;
+        float positionOffset[3] = { 0.0f, 0.0f, 0.0f };
+        if (format != VertexFormat::Float32)
+        {
+            if (VertexPacking::packParameters(verts, mesh.vertices, format, positionScale, positionOffset))
+            {
+                mesh.format = format;
+                mesh.positionScale = positionScale;
+                mesh.positionOffset = glm::vec3(positionOffset[0], positionOffset[1], positionOffset[2]);
+                size = mesh.vertices * VertexPacking::vertexSize(format);
+            }
+            else
+            {
+                std::cout << "INFO: Mesh UVs are outside [0, 1], keeping float vertices" << std::endl;
+            }
+        }
 
-        glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-        glBindVertexArray(mesh.vao);
-
-        // Create 2 buffers: first one for the vertex data; second one for the indices
-        glGenBuffers(1, &mesh.vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-        glBufferData(GL_ARRAY_BUFFER, size, verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-        // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-        GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-        // Create Vertex Attribute Pointers
-        glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-        glEnableVertexAttribArray(0);
-
-        glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-        glEnableVertexAttribArray(1);
+        // Suballocate from the arena for the format; its VAO is shared by every mesh in it
+        GeometryArena& arena = GeometryArena::get(mesh.format);
+        if (mesh.format == VertexFormat::Float32)
+        {
+            mesh.range = arena.allocate(verts, mesh.vertices, indices, indexCount);
+        }
+        else
+        {
+            // Pack straight into the vertex buffer rather than into a packed copy first
+            const VertexFormat packedFormat = mesh.format;
+            mesh.range = arena.allocate(mesh.vertices, indexCount, [&](void* vertexOut, GLuint* indexOut)
+            {
+                VertexPacking::pack(verts, mesh.vertices, packedFormat, positionScale, positionOffset, (VertexPacking::PackedVertex*)vertexOut);
+                std::copy(indices, indices + indexCount, indexOut);
+            });
+        }
+        mesh.vao = arena.vao();
 
-        glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-        glEnableVertexAttribArray(2);
+        if (gReportMeshMemory && indexCount > 0)
+        {
+            size_t eboSize = indexCount * sizeof(GLuint);
+            size_t soupSize = indexCount * VertexPacking::vertexSize(mesh.format);
+            std::cout << "INFO: Mesh at vertex " << mesh.range->baseVertex << ": " << mesh.vertices << " " << VertexPacking::formatName(mesh.format)
+                      << " vertices, " << mesh.indices << " indices, VBO "
+                      << size << " bytes + EBO " << eboSize << " bytes, saved " << (long long)soupSize - (long long)(size + eboSize)
+                      << " bytes over non-indexed (" << soupSize << " bytes)" << std::endl;
+        }
     }
 
-    /*Generate and load the texture*/
-    static bool createTexture(const char* filename, GLuint& textureId)
+    // Create indexed mesh from geometry generated on the CPU
+    static void createMesh(const Tessellation::MeshData& data, GLMesh& mesh, VertexFormat format = VertexFormat::Float32)
     {
-        int width, height, channels;
-        unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-        if (image)
+        createMesh(data.vertices, data.vertexBytes, data.indices, data.indexCount, mesh, format);
+        if (data.topology == Tessellation::Topology::Strips)
         {
-            flipImageVertically(image, width, height, channels);
+            mesh.mode = GL_TRIANGLE_STRIP;
+            mesh.triangles = Tessellation::stripTriangleCount(data.indices, data.indexCount);
+        }
 
-            glGenTextures(1, &textureId);
-            glBindTexture(GL_TEXTURE_2D, textureId);
+        // Quantized positions are a scaled and shifted copy, so move the bounds along with them
+        mesh.clusters.assign(data.clusters, data.clusters + data.clusterCount);
+        for (Tessellation::Cluster& cluster : mesh.clusters)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+                cluster.center[axis] = (cluster.center[axis] - mesh.positionOffset[axis]) / mesh.positionScale;
+            cluster.radius /= mesh.positionScale;
+        }
+    }
 
-            // set texture filtering parameters
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // Make Tessellation::k_RestartIndex end a strip; call once after the context is created
+    static void enablePrimitiveRestart()
+    {
+        // The fixed index needs GL 4.3; the same index can be set explicitly on 4.1
+        if (GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility)
+        {
+            glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+        }
+        else
+        {
+            glEnable(GL_PRIMITIVE_RESTART);
+            glPrimitiveRestartIndex(Tessellation::k_RestartIndex);
+        }
+    }
 
-            if (channels == 3)
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-            else if (channels == 4)
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-            else
-            {
-                std::cout << "Not implemented to handle image with " << channels << " channels" << std::endl;
-                return false;
-            }
+    // Mesh space to object space, to follow the object's model matrix; decodes quantized positions
+    static glm::mat4 meshTransform(const GLMesh& mesh)
+    {
+        if (mesh.format != VertexFormat::Quantized)
+            return glm::mat4(1.0f);
 
-            glGenerateMipmap(GL_TEXTURE_2D);
+        return glm::translate(mesh.positionOffset) * glm::scale(glm::vec3(mesh.positionScale));
+    }
 
-            stbi_image_free(image);
-            glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+    // Take ownership of a mesh created by createMesh
+    static MeshHandle makeMeshHandle(const GLMesh& mesh)
+    {
+        return std::make_shared<GLMesh>(mesh);
+    }
 
-            return true;
+    // Bind a mesh's VAO, skipping the call when the previous mesh drawn used the same arena
+    static void bindMesh(const GLMesh& mesh)
+    {
+        if (boundVao() != mesh.vao)
+        {
+            glBindVertexArray(mesh.vao);
+            boundVao() = mesh.vao;
+            ++frameStats().vaoBinds;
         }
+    }
 
-        // Error loading the image
-        return false;
+    // Issue the draw call for a mesh whose VAO is bound; a mesh without an arena range draws vertex IDs from 0
+    static void drawMesh(const GLMesh& mesh)
+    {
+        ++frameStats().drawCalls;
+        frameStats().triangles += mesh.triangles;
+        if (mesh.indices > 0)
+            glDrawElementsBaseVertex(mesh.mode, mesh.indices, GL_UNSIGNED_INT, (void*)(mesh.range->firstIndex * sizeof(GLuint)), mesh.range->baseVertex);
+        else
+            glDrawArrays(mesh.mode, mesh.range ? mesh.range->baseVertex : 0, mesh.vertices);
     }
 
-    static GLMesh makeCone(float radius, float height, std::uint32_t numSectors = 16)
+    // Draw a mesh with the model matrix its shader uses, leaving out the clusters that are
+    // outside the frustum or face away from the camera; what is left is one multi-draw
+    static void drawMesh(const GLMesh& mesh, const glm::mat4& model)
     {
-        // All vertex data
-        std::vector<float> vertices;
+        if (!gClusterCulling || mesh.clusters.empty() || mesh.mode != GL_TRIANGLES)
+        {
+            drawMesh(mesh);
+            return;
+        }
 
-        // Create circle
-        std::vector<float> unitVertices;
-        float sectorStep = 2 * k_PI / (float)numSectors;
-        float sectorAngle;
-        for (int i = 0; i <= numSectors; ++i)
+        // Camera and frustum planes in the mesh's space, which an affine model matrix keeps culling exact in
+        glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::inverse(frameView())[3]);
+        glm::mat4 clip = frameProjection() * frameView() * model;
+        glm::vec4 planes[6];
+        for (int i = 0; i < 3; ++i)
         {
-            sectorAngle = i * sectorStep;
-            unitVertices.push_back(cos(sectorAngle)); // x
-            unitVertices.push_back(sin(sectorAngle)); // y
-            unitVertices.push_back(0);                // z
+            glm::vec4 row(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+            glm::vec4 w(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+            planes[i * 2] = w + row;
+            planes[i * 2 + 1] = w - row;
+        }
+        for (glm::vec4& plane : planes)
+        {
+            plane /= glm::length(glm::vec3(plane));
         }
 
-        // Sides of cone
-        float h = height / 2.0f;
-        for(int j = 0, k = 0; j <= numSectors; ++j)
+        // Adjacent survivors are merged, so a mostly visible mesh stays a few long ranges
+        static std::vector<GLsizei> counts;
+        static std::vector<const void*> offsets;
+        static std::vector<GLint> baseVertices;
+        counts.clear();
+        offsets.clear();
+        baseVertices.clear();
+
+        size_t culledIndices = 0;
+        GLuint nextIndex = ~0u;
+        for (const Tessellation::Cluster& cluster : mesh.clusters)
         {
-            // Top 2 points
-            for (int w = 0; w < 2; ++w, k += 3)
+            glm::vec3 center(cluster.center[0], cluster.center[1], cluster.center[2]);
+            bool visible = true;
+            for (const glm::vec4& plane : planes)
             {
-                float ux = unitVertices[k];
-                float uy = unitVertices[k+1];
-                float uz = unitVertices[k+2];
-                // position vector
-                vertices.push_back(ux * radius);             // x
-                vertices.push_back(uy * radius);             // y
-                vertices.push_back(h);                       // z
-                // normal vector
-                vertices.push_back(ux);                       // nx
-                vertices.push_back(uy);                       // ny
-                vertices.push_back(uz);                       // nz
-                // texture coordinate
-                vertices.push_back(0);      // s
-                vertices.push_back(1 * w);      // t
+                if (glm::dot(glm::vec3(plane), center) + plane.w < -cluster.radius)
+                    visible = false;
             }
 
-            // Start at first point
-            k -= 6;
+            glm::vec3 toCluster = center - eye;
+            glm::vec3 axis(cluster.coneAxis[0], cluster.coneAxis[1], cluster.coneAxis[2]);
+            if (glm::dot(toCluster, axis) >= cluster.coneCutoff * glm::length(toCluster) + cluster.radius)
+                visible = false;
 
-            // Last point and start of next triangle
-            for (int i = 0; i < 2; ++i)
+            if (!visible)
             {
-                float ux = unitVertices[k];
-                float uy = unitVertices[k+1];
-                float uz = unitVertices[k+2];
-                // position vector
-                vertices.push_back(ux * 0);             // x
-                vertices.push_back(uy * 0);             // y
-                vertices.push_back(-h);                       // z
-                // normal vector
-                vertices.push_back(ux);                       // nx
-                vertices.push_back(uy);                       // ny
-                vertices.push_back(uz);                       // nz
-                // texture coordinate
-                vertices.push_back(1);      // s
-                vertices.push_back(i * 1);      // t
+                culledIndices += cluster.indexCount;
+                continue;
             }
 
-            // Start at top point
-            k += 3;
-
-            // Bottom right and top right
-            for (int i = 0; i < 2; ++i)
+            GLuint first = mesh.range->firstIndex + cluster.firstIndex;
+            if (first == nextIndex)
             {
-                float h = height / 2.0f + i * -height;
-                float ux = unitVertices[k];
-                float uy = unitVertices[k+1];
-                float uz = unitVertices[k+2];
-                // position vector
-                vertices.push_back(ux * radius * i);             // x
-                vertices.push_back(uy * radius * i);             // y
-                vertices.push_back(-h);                       // z
-                // normal vector
-                vertices.push_back(ux);                       // nx
-                vertices.push_back(uy);                       // ny
-                vertices.push_back(uz);                       // nz
-                // texture coordinate
-                vertices.push_back(1 + i * -1);      // s
-                vertices.push_back(1*i);      // t
+                counts.back() += cluster.indexCount;
             }
-        }
-
-        h = height / 2.0f;
-        float nz = 1.0;
-        for(int j = 0, k = 0; j < numSectors; ++j)
-        {
-            for (int w = 0; w < 2; ++w, k += 3)
+            else
             {
-                float ux = unitVertices[k];
-                float uy = unitVertices[k+1];
-                // position vector
-                vertices.push_back(ux * radius);             // vx
-                vertices.push_back(uy * radius);             // vy
-                vertices.push_back(h);                       // vz
-                // normal vector
-                vertices.push_back(0);                        // nx
-                vertices.push_back(0);                        // ny
-                vertices.push_back(nz);                       // nz
-                // texture coordinate
-                vertices.push_back(-ux * 0.5f + 0.5f);      // s
-                vertices.push_back(-uy * 0.5f + 0.5f);      // t
+                counts.push_back(cluster.indexCount);
+                offsets.push_back((const void*)(first * sizeof(GLuint)));
+                baseVertices.push_back(mesh.range->baseVertex);
             }
-
-            // Start at last point
-            k -= 3;
-
-            // Center vertex
-            vertices.push_back(0);
-            vertices.push_back(0);
-            vertices.push_back(h);
-            vertices.push_back(0);
-            vertices.push_back(0);
-            vertices.push_back(nz);
-            vertices.push_back(0.5f);
-            vertices.push_back(0.5f);
+            nextIndex = first + cluster.indexCount;
         }
 
-        GLMesh mesh;
-        createMesh(vertices.data(), vertices.size() * sizeof(float), mesh);
-        return mesh;
+        frameStats().trianglesCulled += culledIndices / 3;
+        if (counts.empty())
+            return;
+
+        ++frameStats().drawCalls;
+        frameStats().triangles += (mesh.indices - culledIndices) / 3;
+        glMultiDrawElementsBaseVertex(mesh.mode, counts.data(), GL_UNSIGNED_INT, offsets.data(), (GLsizei)counts.size(), baseVertices.data());
     }
 
-    static GLMesh makeCylinder(float radius, float height, std::uint32_t numSectors = 16)
+    // Set the camera used for LOD selection and culling and reset the frame counters; call before drawing
+    static void beginFrame(const glm::mat4& view, const glm::mat4& projection, float viewportHeight)
     {
-        // All vertex data
-        std::vector<float> vertices;
+        frameView() = view;
+        frameProjection() = projection;
+        // Pixels covered by one unit at a view depth of one unit
+        pixelsPerUnit() = projection[1][1] * viewportHeight * 0.5f;
+        frameStats() = FrameStats();
+        boundVao() = 0;    // Unknown: anything may have been bound since the last frame
+    }
 
-        // Create circle
-        std::vector<float> unitVertices;
-        float sectorStep = 2 * k_PI / (float)numSectors;
-        float sectorAngle;
-        for (int i = 0; i <= numSectors; ++i)
-        {
-            sectorAngle = i * sectorStep;
-            unitVertices.push_back(cos(sectorAngle)); // x
-            unitVertices.push_back(sin(sectorAngle)); // y
-            unitVertices.push_back(0);                // z
-        }
+    static FrameStats& frameStats()
+    {
+        static FrameStats s_Stats;
+        return s_Stats;
+    }
 
-        // Sides of cylinder
-        float h = -height / 2.0f;
-        for(int j = 0, k = 0; j <= numSectors; ++j)
-        {
-            // Top 2 points
-            for (int w = 0; w < 2; ++w, k += 3)
-            {
-                float ux = unitVertices[k];
-                float uy = unitVertices[k+1];
-                float uz = unitVertices[k+2];
-                // position vector
-                vertices.push_back(ux * radius);             // x
-                vertices.push_back(uy * radius);             // y
-                vertices.push_back(h);                       // z
-                // normal vector
-                vertices.push_back(ux);                       // nx
-                vertices.push_back(uy);                       // ny
-                vertices.push_back(uz);                       // nz
-                // texture coordinate
-                vertices.push_back(0);      // s
-                vertices.push_back(1 * w);      // t
-            }
+    // Radius in pixels of a world space sphere as seen from the frame's camera
+    static float projectedRadius(const glm::vec3& center, float radius)
+    {
+        float depth = -(frameView() * glm::vec4(center, 1.0f)).z;
+        if (depth <= radius)
+            return std::numeric_limits<float>::max();   // Camera is inside or touching it
 
-            // Start at first point
-            k -= 6;
+        return radius * pixelsPerUnit() / depth;
+    }
 
-            // Last point and start of next triangle
-            for (int i = 0; i < 2; ++i)
-            {
-                float ux = unitVertices[k];
-                float uy = unitVertices[k+1];
-                float uz = unitVertices[k+2];
-                // position vector
-                vertices.push_back(ux * radius);             // x
-                vertices.push_back(uy * radius);             // y
-                vertices.push_back(-h);                       // z
-                // normal vector
-                vertices.push_back(ux);                       // nx
-                vertices.push_back(uy);                       // ny
-                vertices.push_back(uz);                       // nz
-                // texture coordinate
-                vertices.push_back(1);      // s
-                vertices.push_back(i * 1);      // t
-            }
+    // Thresholds for a chain whose levels have the given number of segments around their silhouette
+    static std::vector<float> lodThresholds(const std::vector<std::uint32_t>& sectors)
+    {
+        // Level i is still needed while level i + 1's silhouette edges would be longer than k_LodEdgePixels
+        std::vector<float> minPixels;
+        for (size_t i = 1; i < sectors.size(); ++i)
+        {
+            minPixels.push_back(k_LodEdgePixels * sectors[i] / (2.0f * k_PI));
+        }
+        return minPixels;
+    }
 
-            // Start at top point
-            k += 3;
+    // Level of a chain for a bounding sphere in world space
+    static const GLMesh& selectLod(LodChain& chain, const glm::vec3& center, float radius)
+    {
+        if (!gLodEnabled)
+            return *chain.levels[0];
+
+        float pixels = projectedRadius(center, radius);
+        size_t level = chain.current;
+        while (level > 0 && pixels > chain.minPixels[level - 1] * (1.0f + k_LodHysteresis))
+            --level;
+        while (level + 1 < chain.levels.size() && pixels < chain.minPixels[level] * (1.0f - k_LodHysteresis))
+            ++level;
+
+        chain.current = level;
+        return *chain.levels[level];
+    }
 
-            // Bottom right and top right
-            for (int i = 0; i < 2; ++i)
-            {
-                float h = -height / 2.0f + i * height;
-                float ux = unitVertices[k];
-                float uy = unitVertices[k+1];
-                float uz = unitVertices[k+2];
-                // position vector
-                vertices.push_back(ux * radius);             // x
-                vertices.push_back(uy * radius);             // y
-                vertices.push_back(-h);                       // z
-                // normal vector
-                vertices.push_back(ux);                       // nx
-                vertices.push_back(uy);                       // ny
-                vertices.push_back(uz);                       // nz
-                // texture coordinate
-                vertices.push_back(1 + i * -1);      // s
-                vertices.push_back(1*i);      // t
-            }
-        }
+    // Generate float vertices straight into the mesh's arena range, with no geometry on the host:
+    // fill(float* vertices, GLuint* indices) writes exactly vertexCount vertices and indexCount indices
+    template <typename Fill>
+    static void generateMesh(size_t vertexCount, size_t indexCount, GLMesh& mesh, Fill fill)
+    {
+        mesh.vertices = vertexCount;
+        mesh.indices = indexCount;
+        mesh.mode = GL_TRIANGLES;
+        mesh.triangles = (indexCount > 0 ? indexCount : vertexCount) / 3;
+        mesh.format = VertexFormat::Float32;
+        mesh.positionScale = 1.0f;
+        mesh.positionOffset = glm::vec3(0.0f);
+
+        GeometryArena& arena = GeometryArena::get(mesh.format);
+        mesh.range = arena.allocate(vertexCount, indexCount, [&](void* vertices, GLuint* indices) { fill((float*)vertices, indices); });
+        mesh.vao = arena.vao();
+    }
 
-        for (int i = 0; i < 2; ++i)
+    static GLMesh makeCone(float radius, float height, std::uint32_t numSectors = 16)
+    {
+        GLMesh mesh;
+        generateMesh(Tessellation::coneVertexCount(numSectors), Tessellation::coneIndexCount(numSectors), mesh, [&](float* vertices, GLuint* indices)
         {
-            float h = -height / 2.0f + i * height;
-            float nz = -1.0 * i;
-            for(int j = 0, k = 0; j < numSectors; ++j)
-            {
-                for (int w = 0; w < 2; ++w, k += 3)
-                {
-                    float ux = unitVertices[k];
-                    float uy = unitVertices[k+1];
-                    // position vector
-                    vertices.push_back(ux * radius);             // vx
-                    vertices.push_back(uy * radius);             // vy
-                    vertices.push_back(h);                       // vz
-                    // normal vector
-                    vertices.push_back(0);                        // nx
-                    vertices.push_back(0);                        // ny
-                    vertices.push_back(nz);                       // nz
-                    // texture coordinate
-                    vertices.push_back(-ux * 0.5f + 0.5f);      // s
-                    vertices.push_back(-uy * 0.5f + 0.5f);      // t
-                }
-
-                // Start at last point
-                k -= 3;
-
-                // Center vertex
-                vertices.push_back(0);
-                vertices.push_back(0);
-                vertices.push_back(h);
-                vertices.push_back(0);
-                vertices.push_back(0);
-                vertices.push_back(nz);
-                vertices.push_back(0.5f);
-                vertices.push_back(0.5f);
-            }
-        }
+            Tessellation::writeCone(radius, height, numSectors, vertices, indices);
+        });
+        return mesh;
+    }
 
+    static GLMesh makeCylinder(float radius, float height, std::uint32_t numSectors = 16)
+    {
         GLMesh mesh;
-        createMesh(vertices.data(), vertices.size() * sizeof(float), mesh);
+        generateMesh(Tessellation::cylinderVertexCount(numSectors), Tessellation::cylinderIndexCount(numSectors), mesh, [&](float* vertices, GLuint* indices)
+        {
+            Tessellation::writeCylinder(radius, height, numSectors, vertices, indices);
+        });
         return mesh;
     }
 
     static GLMesh makeSphere(float radius, std::uint32_t stacks, std::uint32_t sectors)
     {
-        std::vector<float> vertices;
-        float lengthInv = 1.0f / radius;
-        float sectorStep = 2 * k_PI / sectors;
-        float stackStep = k_PI / stacks;
-
-        for (int i = 0; i <= stacks; ++i)
+        GLMesh mesh;
+        generateMesh(Tessellation::sphereVertexCount(stacks, sectors), Tessellation::sphereIndexCount(stacks, sectors), mesh, [&](float* vertices, GLuint* indices)
         {
-            float stackAngle = k_PI / 2 - i * stackStep;
-            float xy = radius * std::cosf(stackAngle);
-            float z = radius * std::sinf(stackAngle);
+            Tessellation::writeSphere(radius, stacks, sectors, vertices, indices);
+        });
+        return mesh;
+    }
 
-            for(int j = 0; j <= sectors; ++j)
-            {
-                float sectorAngle = j * sectorStep;
-
-                // Position
-                float x = xy * std::cosf(sectorAngle);
-                float y = xy * std::sinf(sectorAngle);
-                vertices.push_back(x);
-                vertices.push_back(y);
-                vertices.push_back(z);
-
-                // Normals
-                vertices.push_back(x * lengthInv);
-                vertices.push_back(y * lengthInv);
-                vertices.push_back(z * lengthInv);
-
-                // Textutre UV
-                vertices.push_back((float)j / sectors);
-                vertices.push_back((float)i / stacks);
-            }
-        }
+    // Compile-time tessellations: no trig and one exact allocation, e.g. makeSphere<200, 200>(0.5f)
+    template <std::uint32_t NumSectors>
+    static GLMesh makeCone(float radius, float height)
+    {
+        auto geometry = Tessellation::buildCone<NumSectors>(radius, height);
 
-        // Create indices
-        std::vector<float> fullVertexData;
-        int k1, k2;
-        for (int i = 0; i < stacks; ++i)
-        {
-            k1 = i * (sectors + 1);     // beginning of current stack
-            k2 = k1 + sectors + 1;      // beginning of next stack
+        GLMesh mesh;
+        createMesh(geometry->vertices, sizeof(geometry->vertices), geometry->indices, Tessellation::coneIndexCount(NumSectors), mesh);
+        return mesh;
+    }
 
-            for(int j = 0; j < sectors; ++j, ++k1, ++k2)
-            {
-                if(i != 0)
-                {
-                    for (int w = 0; w < 8; ++w) fullVertexData.push_back(vertices[k1 * 8 + w]);
-                    for (int w = 0; w < 8; ++w) fullVertexData.push_back(vertices[k2 * 8 + w]);
-                    for (int w = 0; w < 8; ++w) fullVertexData.push_back(vertices[(k1 + 1) * 8 + w]);
-                }
-
-                if(i != (stacks-1))
-                {
-                    for (int w = 0; w < 8; ++w) fullVertexData.push_back(vertices[(k1 + 1) * 8 + w]);
-                    for (int w = 0; w < 8; ++w) fullVertexData.push_back(vertices[k2 * 8 + w]);
-                    for (int w = 0; w < 8; ++w) fullVertexData.push_back(vertices[(k2 + 1) * 8 + w]);
-                }
-            }
-        }
+    template <std::uint32_t NumSectors>
+    static GLMesh makeCylinder(float radius, float height)
+    {
+        auto geometry = Tessellation::buildCylinder<NumSectors>(radius, height);
 
         GLMesh mesh;
-        createMesh(fullVertexData.data(), fullVertexData.size() * sizeof(float), mesh);
+        createMesh(geometry->vertices, sizeof(geometry->vertices), geometry->indices, Tessellation::cylinderIndexCount(NumSectors), mesh);
         return mesh;
     }
 
-    // Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-    static void flipImageVertically(unsigned char* image, int width, int height, int channels)
+    template <std::uint32_t Stacks, std::uint32_t Sectors>
+    static GLMesh makeSphere(float radius)
     {
-        for (int j = 0; j < height / 2; ++j)
-        {
-            int index1 = j * width * channels;
-            int index2 = (height - 1 - j) * width * channels;
+        auto geometry = Tessellation::buildSphere<Stacks, Sectors>(radius);
+
+        GLMesh mesh;
+        createMesh(geometry->vertices, sizeof(geometry->vertices), geometry->indices, Tessellation::sphereIndexCount(Stacks, Sectors), mesh);
+        return mesh;
+    }
+
+protected:
+    Object() { }
+
+
+    // Load an image in load() and keep it for uploadImages()
+    bool loadTextureImage(const char* filename)
+    {
+        TextureCache::Request request;
+        if (!TextureCache::load(filename, request))
+            return false;
+
+        m_TextureRequests.push_back(std::move(request));
+        return true;
+    }
 
-            for (int i = width * channels; i > 0; --i)
+    // Upload the images loaded in load(), in order, into m_Textures; files already uploaded are shared
+    bool uploadImages()
+    {
+        bool success = true;
+        for (const TextureCache::Request& request : m_TextureRequests)
+        {
+            TextureHandle texture = TextureCache::upload(request);
+            if (!texture)
             {
-                unsigned char tmp = image[index1];
-                image[index1] = image[index2];
-                image[index2] = tmp;
-                ++index1;
-                ++index2;
+                success = false;
+                break;
             }
+            m_Textures.push_back(texture);
         }
+
+        m_TextureRequests.clear();
+        return success;
     }
 
-protected:
-    Object() { }
+    // Upload the images loaded in load() as the layers of one array texture, added to m_Textures
+    bool uploadImageArray()
+    {
+        TextureHandle texture = TextureCache::uploadArray(m_TextureRequests);
+        m_TextureRequests.clear();
+        if (!texture)
+            return false;
+
+        m_Textures.push_back(texture);
+        return true;
+    }
 
-    std::vector<GLMesh> m_Meshes;
-    std::vector<GLuint> m_Textures;
+    std::vector<MeshHandle> m_Meshes;
+    std::vector<LodChain> m_Lods;
+    std::vector<TextureHandle> m_Textures;
+    std::vector<TextureCache::Request> m_TextureRequests;   // Loaded by load(), waiting for upload()
     glm::vec3 m_Position = { 0, 0, 0 };
     glm::vec3 m_Rotation = { 0, 0, 0 };
     glm::vec3 m_Scale = { 1.0f, 1.0f, 1.0f };
 
+private:
+    // View matrix of the frame being drawn
+    static glm::mat4& frameView()
+    {
+        static glm::mat4 s_View(1.0f);
+        return s_View;
+    }
+
+    static glm::mat4& frameProjection()
+    {
+        static glm::mat4 s_Projection(1.0f);
+        return s_Projection;
+    }
+
+    static float& pixelsPerUnit()
+    {
+        static float s_PixelsPerUnit = 1.0f;
+        return s_PixelsPerUnit;
+    }
+
+    // VAO last bound by bindMesh this frame, 0 when unknown
+    static GLuint& boundVao()
+    {
+        static GLuint s_Vao = 0;
+        return s_Vao;
+    }
 };
 
 #endif // OBJECT_H
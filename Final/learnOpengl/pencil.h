@@ -1,47 +1,55 @@
 #ifndef PENCIL_H
 #define PENCIL_H
 
-#include "object.h"
+#include "renderqueue.h"   // Object and the draws it queues
+#include "meshregistry.h"
 
 class Pencil : public Object
 {
 public:
-    // Initialize textures, vertices, etc.
-    virtual bool initialize()
+    // Generate meshes and decode textures
+    virtual bool load()
     {
-        // Create body mesh
-        m_Meshes.push_back(makeCylinder(0.1, 3, 6));
-
-        // Create eraser mesh
-        m_Meshes.push_back(makeCylinder(0.1, 0.2));
-
-        // Create point mesh
-        m_Meshes.push_back(makeCone(0.1, 0.1));
-
-        GLuint textureId;
-        if (!createTexture("./textures/pencil_color.png", textureId))
-        {
-            return false;
-        }
-        m_Textures.push_back(textureId);
+        // Body mesh, a unit length hexagonal cylinder stretched by the model matrix
+        m_MeshRequests.push_back(MeshRegistry::generateCylinder<6>(0.1f, 1.0f));
+
+        // Eraser and point, round so they get coarser levels for a distant pencil
+        m_LodRequests.resize(2);
+        m_LodRequests[0].push_back(MeshRegistry::generateCylinder<64>(0.1f, 1.0f));
+        m_LodRequests[0].push_back(MeshRegistry::generateCylinder<32>(0.1f, 1.0f));
+        m_LodRequests[0].push_back(MeshRegistry::generateCylinder<16>(0.1f, 1.0f));
+        m_LodRequests[0].push_back(MeshRegistry::generateCylinder<6>(0.1f, 1.0f));
+
+        m_LodRequests[1].push_back(MeshRegistry::generateCone<64>(0.1f, 0.1f));
+        m_LodRequests[1].push_back(MeshRegistry::generateCone<32>(0.1f, 0.1f));
+        m_LodRequests[1].push_back(MeshRegistry::generateCone<16>(0.1f, 0.1f));
+        m_LodRequests[1].push_back(MeshRegistry::generateCone<6>(0.1f, 0.1f));
+
+        return loadTextureImage("./textures/pencil_color.png") &&
+               loadTextureImage("./textures/pencil_top.png") &&
+               loadTextureImage("./textures/wood.png");
+    }
 
-        if (!createTexture("./textures/pencil_top.png", textureId))
+    // Upload meshes and textures
+    virtual bool upload()
+    {
+        for (const auto& request : m_MeshRequests)
         {
-            return false;
+            m_Meshes.push_back(MeshRegistry::upload(request));
         }
-        m_Textures.push_back(textureId);
+        m_MeshRequests.clear();
 
-        if (!createTexture("./textures/wood.png", textureId))
+        for (const auto& requests : m_LodRequests)
         {
-            return false;
+            m_Lods.push_back(MeshRegistry::uploadLod(requests));
         }
-        m_Textures.push_back(textureId);
+        m_LodRequests.clear();
 
-        return true;
+        return uploadImages();
     }
 
     // Draw
-    virtual void draw(GLint modelHandle)
+    virtual void draw(RenderQueue& queue, ShaderProgram& program)
     {
         glm::mat4 scale = glm::scale(glm::vec3(m_Scale.x, m_Scale.y, m_Scale.z));
         glm::mat4 rotation = glm::rotate(glm::radians(m_Rotation.z), glm::vec3(0.0f, 0.0f, 1.0f)) *
@@ -49,54 +57,32 @@ public:
                              glm::rotate(glm::radians(m_Rotation.x), glm::vec3(0.0f, 1.0f, 0.0f));
         glm::mat4 translation = glm::translate(glm::vec3(m_Position.x, m_Position.y, m_Position.z));
 
-        glm::mat4 model = translation * rotation  * scale;
-        glUniformMatrix4fv(modelHandle, 1, GL_FALSE, glm::value_ptr(model));
+        glm::mat4 model = translation * rotation  * scale * glm::scale(glm::vec3(1.0f, 1.0f, 3.0f)) * meshTransform(*m_Meshes[0]);
 
-        // Bind VAO
-        glBindVertexArray(m_Meshes[0].vao);
-
-        // Bind the face color
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_Textures[0]);
-
-        // Draw
-        glDrawArrays(GL_TRIANGLES, 0, m_Meshes[0].vertices);
+        // Draw body with the face color
+        queue.add(program, *m_Meshes[0], m_Textures[0], model);
 
         // Draw eraser
         float pencilTopZ = 3.0 / 2 + 0.2 / 2;
         glm::vec4 transform = rotation * glm::vec4(0, 0, pencilTopZ, 0);
         glm::mat4 t2 = translation * glm::translate(glm::vec3(transform.x, transform.y, transform.z));
 
-        model = t2 * rotation * scale;
-        glUniformMatrix4fv(modelHandle, 1, GL_FALSE, glm::value_ptr(model));
-
-        // Bind VAO
-        glBindVertexArray(m_Meshes[1].vao);
+        // Round parts are picked by the size of their cross section on screen
+        float radius = 0.1f * std::max(m_Scale.x, m_Scale.y);
+        const GLMesh& eraser = selectLod(m_Lods[0], glm::vec3(t2[3]), radius);
 
-        // Bind the face color
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_Textures[1]);
-
-        // Draw
-        glDrawArrays(GL_TRIANGLES, 0, m_Meshes[1].vertices);
+        model = t2 * rotation * scale * glm::scale(glm::vec3(1.0f, 1.0f, 0.2f)) * meshTransform(eraser);
+        queue.add(program, eraser, m_Textures[1], model);
 
         // Draw point
         pencilTopZ = 3.0 / 2 + 0.1 / 2;
         transform = rotation * glm::vec4(0, 0, -pencilTopZ, 0);
         glm::mat4 t3 = translation * glm::translate(glm::vec3(transform.x, transform.y, transform.z));
 
-        model = t3 * rotation * scale;
-        glUniformMatrix4fv(modelHandle, 1, GL_FALSE, glm::value_ptr(model));
-
-        // Bind VAO
-        glBindVertexArray(m_Meshes[2].vao);
-
-        // Bind the face color
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_Textures[2]);
+        const GLMesh& point = selectLod(m_Lods[1], glm::vec3(t3[3]), radius);
 
-        // Draw
-        glDrawArrays(GL_TRIANGLES, 0, m_Meshes[2].vertices);
+        model = t3 * rotation * scale * meshTransform(point);
+        queue.add(program, point, m_Textures[2], model);
     }
 
     // Update based on fps
@@ -105,6 +91,9 @@ public:
 
     }
 
+private:
+    std::vector<MeshRegistry::Request> m_MeshRequests;
+    std::vector<std::vector<MeshRegistry::Request>> m_LodRequests;     // Eraser and point, finest level first
 };
 
 #endif // PENCIL_H
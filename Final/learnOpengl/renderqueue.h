@@ -0,0 +1,229 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "object.h"
+
+// One draw as queued by Object::draw(): what to bind and the model matrix to draw it with
+struct DrawPacket
+{
+    ShaderProgram* program = nullptr;
+    const GLMesh* mesh = nullptr;       // Owned by the object, which outlives the frame
+    GLTexture* texture = nullptr;       // Array textures go to unit 1 and switch the shader to textureLayered
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::ivec2 sphereTessellation = glm::ivec2(0, 0);   // Stacks and sectors for a procedural sphere
+    bool clusterCulling = false;        // Leave out the mesh's clusters the camera cannot see
+    float depth = 0.0f;                 // View depth of the model's origin
+};
+
+// Collects a frame's draw packets and submits them sorted by a 64-bit key, so
+// draws sharing a program, texture and vertex array run back to back and each
+// is bound once rather than once per object. From the top bit down the key is
+//
+//     program (8) | texture (16) | vertex array (16) | depth (24)
+//
+// with the names truncated to their low bits, which only costs a few extra binds
+// should two of them collide. Within a state, draws go front to back so early
+// depth testing rejects more of the hidden fragments.
+class RenderQueue
+{
+public:
+    // Depth the key's depth bits span; further draws share the last value. The projection's far plane.
+    static constexpr float k_MaxDepth = 100.0f;
+
+    // Binds and program switches needed by an order of the packets
+    struct StateChanges
+    {
+        size_t programs = 0;
+        size_t vertexArrays = 0;
+        size_t textures = 0;
+
+        size_t total() const { return programs + vertexArrays + textures; }
+    };
+
+    // Last frame's packets and what they cost in queued order and in the order submitted
+    struct Stats
+    {
+        size_t packets = 0;
+        StateChanges unsorted;
+        StateChanges sorted;
+    };
+
+    // Sort before submitting; when off the packets are drawn as queued
+    static bool& sorting()
+    {
+        static bool s_Sorting = true;
+        return s_Sorting;
+    }
+
+    // Start a frame seen from the given view
+    void begin(const glm::mat4& view)
+    {
+        m_View = view;
+        m_Packets.clear();
+    }
+
+    // Queue a mesh; the returned packet may be adjusted until submit()
+    DrawPacket& add(ShaderProgram& program, const GLMesh& mesh, const TextureHandle& texture, const glm::mat4& model)
+    {
+        m_Packets.emplace_back();
+        DrawPacket& packet = m_Packets.back();
+        packet.program = &program;
+        packet.mesh = &mesh;
+        packet.texture = texture.get();
+        packet.model = model;
+        packet.depth = -(m_View * model[3]).z;
+        return packet;
+    }
+
+    // Sort the frame's packets and draw them, binding only what changes between one and the next
+    void submit()
+    {
+        m_Order.resize(m_Packets.size());
+        for (size_t i = 0; i < m_Packets.size(); ++i)
+            m_Order[i] = (std::uint32_t)i;
+
+        m_Stats.packets = m_Packets.size();
+        m_Stats.unsorted = stateChanges(m_Order);
+        if (sorting())
+            sort();
+        m_Stats.sorted = stateChanges(m_Order);
+
+        ShaderProgram* program = nullptr;
+        GLuint textures[2] = { 0, 0 };      // Bound to units 0 and 1, 0 when not known
+        for (std::uint32_t index : m_Order)
+        {
+            const DrawPacket& packet = m_Packets[index];
+            if (packet.program != program)
+            {
+                program = packet.program;
+                program->use();
+            }
+
+            Object::bindMesh(*packet.mesh);
+
+            GLint layered = 0;
+            if (packet.texture)
+            {
+                // Samplers of different types may not share a unit, so arrays have their own
+                layered = packet.texture->target == GL_TEXTURE_2D_ARRAY ? 1 : 0;
+                if (textures[layered] != packet.texture->id)
+                {
+                    glActiveTexture(GL_TEXTURE0 + layered);
+                    glBindTexture(packet.texture->target, packet.texture->id);
+                    textures[layered] = packet.texture->id;
+                }
+                TextureResidency::touch(*packet.texture);
+            }
+
+            program->set(ShaderProgram::Model, packet.model);
+            program->set(ShaderProgram::TextureLayered, layered);
+            program->set(ShaderProgram::SphereTessellation, packet.sphereTessellation);
+
+            if (packet.clusterCulling)
+                Object::drawMesh(*packet.mesh, packet.model);
+            else
+                Object::drawMesh(*packet.mesh);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    const Stats& stats() const { return m_Stats; }
+
+private:
+    static std::uint64_t key(const DrawPacket& packet)
+    {
+        float depth = std::min(std::max(packet.depth / k_MaxDepth, 0.0f), 1.0f);
+        std::uint64_t key = (std::uint64_t)(packet.program->id() & 0xFF) << 56;
+        key |= (std::uint64_t)((packet.texture ? packet.texture->id : 0) & 0xFFFF) << 40;
+        key |= (std::uint64_t)(packet.mesh->vao & 0xFFFF) << 24;
+        key |= (std::uint64_t)(depth * 0xFFFFFF);
+        return key;
+    }
+
+    // Least significant digit radix sort of the keys, a byte per pass; stable, so equal keys keep their queued order.
+    // Passes over a byte every key shares, such as the program's while there is one program, are skipped.
+    void sort()
+    {
+        size_t count = m_Order.size();
+        m_Keys.resize(count);
+        m_ScratchKeys.resize(count);
+        m_ScratchOrder.resize(count);
+        for (size_t i = 0; i < count; ++i)
+            m_Keys[i] = key(m_Packets[i]);
+
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            size_t offsets[256] = {};
+            for (std::uint64_t key : m_Keys)
+                ++offsets[(key >> shift) & 0xFF];
+            if (count == 0 || offsets[(m_Keys[0] >> shift) & 0xFF] == count)
+                continue;
+
+            size_t start = 0;
+            for (size_t& offset : offsets)
+            {
+                size_t digits = offset;
+                offset = start;
+                start += digits;
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                size_t to = offsets[(m_Keys[i] >> shift) & 0xFF]++;
+                m_ScratchKeys[to] = m_Keys[i];
+                m_ScratchOrder[to] = m_Order[i];
+            }
+            m_Keys.swap(m_ScratchKeys);
+            m_Order.swap(m_ScratchOrder);
+        }
+    }
+
+    // What drawing the packets in an order would bind, following submit()'s rules
+    StateChanges stateChanges(const std::vector<std::uint32_t>& order) const
+    {
+        StateChanges changes;
+        const ShaderProgram* program = nullptr;
+        GLuint vertexArray = 0;
+        GLuint textures[2] = { 0, 0 };
+        for (std::uint32_t index : order)
+        {
+            const DrawPacket& packet = m_Packets[index];
+            if (packet.program != program)
+            {
+                program = packet.program;
+                ++changes.programs;
+            }
+            if (packet.mesh->vao != vertexArray)
+            {
+                vertexArray = packet.mesh->vao;
+                ++changes.vertexArrays;
+            }
+            if (packet.texture)
+            {
+                int unit = packet.texture->target == GL_TEXTURE_2D_ARRAY ? 1 : 0;
+                if (textures[unit] != packet.texture->id)
+                {
+                    textures[unit] = packet.texture->id;
+                    ++changes.textures;
+                }
+            }
+        }
+        return changes;
+    }
+
+    glm::mat4 m_View = glm::mat4(1.0f);
+    std::vector<DrawPacket> m_Packets;
+    std::vector<std::uint32_t> m_Order;         // Indices into m_Packets in the order they are drawn
+    std::vector<std::uint64_t> m_Keys;
+    std::vector<std::uint64_t> m_ScratchKeys;
+    std::vector<std::uint32_t> m_ScratchOrder;
+    Stats m_Stats;
+};
+
+#endif // RENDERQUEUE_H
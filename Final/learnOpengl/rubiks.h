@@ -1,13 +1,24 @@
 #ifndef RUBIKS_H
 #define RUBIKS_H
 
-#include "object.h"
+#include "renderqueue.h"   // Object and the draws it queues
 
 class Rubiks : public Object
 {
 public:
-    // Initialize textures, vertices, etc.
-    virtual bool initialize()
+    // Decode the sticker colors, one layer each
+    virtual bool load()
+    {
+        return loadTextureImage("./textures/blue.png") &&
+               loadTextureImage("./textures/orange.png") &&
+               loadTextureImage("./textures/green.png") &&
+               loadTextureImage("./textures/red.png") &&
+               loadTextureImage("./textures/white.png") &&
+               loadTextureImage("./textures/yellow.png");
+    }
+
+    // Upload vertices and textures
+    virtual bool upload()
     {
         // Texture coordinates for each vertex
         GLfloat verts[] =
@@ -23,100 +34,51 @@ public:
            -0.5f, -0.5f, 0.0f,     0.0f, 0.0f, -1.0f,      0.0f, 0.0f
         };
 
-        // Create mesh
-        GLMesh mesh;
-        createMesh(verts, sizeof(verts), mesh);
-        m_Meshes.push_back(mesh);
-
-        // Load textures
-        GLuint textureId;
-        if (!createTexture("./textures/blue.png", textureId))
-        {
-            return false;
-        }
-        m_Textures.push_back(textureId);
-        if (!createTexture("./textures/orange.png", textureId))
-        {
-            return false;
-        }
-        m_Textures.push_back(textureId);
-        if (!createTexture("./textures/green.png", textureId))
-        {
-            return false;
-        }
-        m_Textures.push_back(textureId);
-        if (!createTexture("./textures/red.png", textureId))
-        {
-            return false;
-        }
-        m_Textures.push_back(textureId);
-        if (!createTexture("./textures/white.png", textureId))
-        {
-            return false;
-        }
-        m_Textures.push_back(textureId);
-        if (!createTexture("./textures/yellow.png", textureId))
+        // Place a copy of the face on each side of the cube, with the layer of its color packed into U
+        const int floatsPerVertex = 8;
+        const int faceVertices = 6;
+        GLfloat cube[6 * faceVertices * floatsPerVertex];
+        GLfloat* out = cube;
+        for (int face = 0; face < 6; ++face)
         {
-            return false;
+            glm::mat4 transform = faceTransform(face);
+            for (int v = 0; v < faceVertices; ++v)
+            {
+                const GLfloat* in = verts + v * floatsPerVertex;
+                glm::vec4 position = transform * glm::vec4(in[0], in[1], in[2], 1.0f);
+                glm::vec4 normal = transform * glm::vec4(in[3], in[4], in[5], 0.0f);
+                *out++ = position.x;
+                *out++ = position.y;
+                *out++ = position.z;
+                *out++ = normal.x;
+                *out++ = normal.y;
+                *out++ = normal.z;
+                *out++ = in[6] + 2.0f * face;
+                *out++ = in[7];
+            }
         }
-        m_Textures.push_back(textureId);
 
-        return true;
+        // Create mesh
+        GLMesh mesh;
+        createMesh(cube, sizeof(cube), mesh);
+        m_Meshes.push_back(makeMeshHandle(mesh));
+
+        // One array texture holds all six colors
+        return uploadImageArray();
     }
 
     // Draw
-    virtual void draw(GLint modelHandle)
+    virtual void draw(RenderQueue& queue, ShaderProgram& program)
     {
         glm::mat4 scale = glm::scale(glm::vec3(m_Scale.x, m_Scale.y, m_Scale.z));
         glm::mat4 rotation = glm::rotate(m_Rotation.z, glm::vec3(0.0f, 0.0f, 1.0f)) *
                              glm::rotate(m_Rotation.y, glm::vec3(1.0f, 0.0f, 0.0f)) *
                              glm::rotate(m_Rotation.x, glm::vec3(0.0f, 1.0f, 0.0f));
         glm::mat4 translation = glm::translate(glm::vec3(m_Position.x, m_Position.y, m_Position.z));
-        for (int i = 0; i < 6; ++i)
-        {
-            // Activate the VBOs contained within the mesh's VAO
-            glBindVertexArray(m_Meshes[0].vao);
-
-            // Bind the face color
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, m_Textures[i]);
-
-            // Rotate face
-            glm::mat4 faceTranslation, faceRotation;
-            switch (i)
-            {
-            case 0:
-                faceRotation = glm::rotate(0.0f, glm::vec3(0.0, 1.0f, 0.0f));
-                faceTranslation = glm::translate(glm::vec3(0.0f, 0.0f, 0.5f));
-                break;
-            case 1:
-                faceRotation = glm::rotate(glm::radians(90.0f), glm::vec3(0.0, 1.0f, 0.0f));
-                faceTranslation = glm::translate(glm::vec3(0.5f, 0.0f, 0.0f));
-                break;
-            case 2:
-                faceRotation = glm::rotate(glm::radians(90.0f), glm::vec3(0.0, 1.0f, 0.0f));
-                faceTranslation = glm::translate(glm::vec3(-0.5f, 0.0f, 0.0f));
-                break;
-            case 3:
-                faceRotation = glm::rotate(glm::radians(90.0f), glm::vec3(1.0, 0.0f, 0.0f));
-                faceTranslation = glm::translate(glm::vec3(0.0f, -0.5f, 0.0f));
-                break;
-            case 4:
-                faceRotation = glm::rotate(glm::radians(90.0f), glm::vec3(-1.0, 0.0f, 0.0f));
-                faceTranslation = glm::translate(glm::vec3(0.0f, 0.5f, 0.0f));
-                break;
-            case 5:
-                faceRotation = glm::rotate(glm::radians(180.0f), glm::vec3(0.0, 1.0f, 0.0f));
-                faceTranslation = glm::translate(glm::vec3(0.0f, 0.0f, -0.5f));
-                break;
-            };
+        glm::mat4 model = translation * rotation * scale;
 
-            glm::mat4 model = translation * faceTranslation * rotation * faceRotation * scale;
-            glUniformMatrix4fv(modelHandle, 1, GL_FALSE, glm::value_ptr(model));
-
-            // Draws the triangles
-            glDrawArrays(GL_TRIANGLES, 0, m_Meshes[0].vertices);
-        }
+        // The triangles of all six faces, colored from the array texture's layers
+        queue.add(program, *m_Meshes[0], m_Textures[0], model);
     }
 
     // Update based on fps
@@ -124,6 +86,41 @@ public:
     {
 
     }
+
+private:
+    // Moves the face quad, centered at the origin facing -Z, onto side i of the cube
+    static glm::mat4 faceTransform(int i)
+    {
+        glm::mat4 faceTranslation, faceRotation;
+        switch (i)
+        {
+        case 0:
+            faceRotation = glm::rotate(0.0f, glm::vec3(0.0, 1.0f, 0.0f));
+            faceTranslation = glm::translate(glm::vec3(0.0f, 0.0f, 0.5f));
+            break;
+        case 1:
+            faceRotation = glm::rotate(glm::radians(90.0f), glm::vec3(0.0, 1.0f, 0.0f));
+            faceTranslation = glm::translate(glm::vec3(0.5f, 0.0f, 0.0f));
+            break;
+        case 2:
+            faceRotation = glm::rotate(glm::radians(90.0f), glm::vec3(0.0, 1.0f, 0.0f));
+            faceTranslation = glm::translate(glm::vec3(-0.5f, 0.0f, 0.0f));
+            break;
+        case 3:
+            faceRotation = glm::rotate(glm::radians(90.0f), glm::vec3(1.0, 0.0f, 0.0f));
+            faceTranslation = glm::translate(glm::vec3(0.0f, -0.5f, 0.0f));
+            break;
+        case 4:
+            faceRotation = glm::rotate(glm::radians(90.0f), glm::vec3(-1.0, 0.0f, 0.0f));
+            faceTranslation = glm::translate(glm::vec3(0.0f, 0.5f, 0.0f));
+            break;
+        default:
+            faceRotation = glm::rotate(glm::radians(180.0f), glm::vec3(0.0, 1.0f, 0.0f));
+            faceTranslation = glm::translate(glm::vec3(0.0f, 0.0f, -0.5f));
+            break;
+        };
+        return faceTranslation * faceRotation;
+    }
 };
 
 #endif // RUBIKS_H
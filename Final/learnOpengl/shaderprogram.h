@@ -0,0 +1,307 @@
+#ifndef SHADERPROGRAM_H
+#define SHADERPROGRAM_H
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Linked vertex and fragment shaders with their active uniforms and attributes
+// looked up once, after linking. Uniforms the scene sets are named by a slot of
+// the Uniform enum instead of a string, and set() skips the GL call when a
+// slot already holds the value, so a steady frame only uploads what changed.
+// Values go through glProgramUniform*, so the program need not be in use; as
+// the cache assumes nothing else sets the program's uniforms, set them all here.
+// Camera and lights are not among them: they come from the FrameData block that
+// FrameUniforms writes once per frame for every program.
+class ShaderProgram
+{
+public:
+    // Uniforms of the scene's shaders outside blocks; a program without one ignores it
+    enum Uniform
+    {
+        Model,
+        ObjectColor,
+        UVScale,
+        Texture,                // sampler2D
+        TextureArray,           // sampler2DArray, for textureLayered
+        TextureLayered,
+        SphereTessellation,
+        UniformCount
+    };
+
+    // Active uniform, attribute or uniform block as reflected after linking
+    struct Variable
+    {
+        std::string name;
+        GLenum type = 0;        // 0 for blocks
+        GLint size = 0;         // Array length, 1 for plain variables; bytes for blocks
+        GLint location = -1;    // Block index for blocks, -1 for uniforms inside one
+    };
+
+    // Uploads made and skipped as redundant, over all programs, since the stats were last reset to Stats()
+    struct Stats
+    {
+        size_t uploads = 0;
+        size_t skipped = 0;
+    };
+
+    // Compile and link, then look up the uniforms and attributes
+    bool create(const char* vtxShaderSource, const char* fragShaderSource)
+    {
+        // Compilation and linkage error reporting
+        int success = 0;
+        char infoLog[512];
+
+        // Create a Shader program object.
+        m_Id = glCreateProgram();
+
+        // Create the vertex and fragment shader objects
+        GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+        GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+
+        // Retrive the shader source
+        glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
+        glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+
+        // Compile the vertex shader, and print compilation errors (if any)
+        glCompileShader(vertexShaderId); // compile the vertex shader
+        // check for shader compile errors
+        glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+
+            return false;
+        }
+
+        glCompileShader(fragmentShaderId); // compile the fragment shader
+        // check for shader compile errors
+        glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
+            std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+
+            return false;
+        }
+
+        // Attached compiled shaders to the shader program
+        glAttachShader(m_Id, vertexShaderId);
+        glAttachShader(m_Id, fragmentShaderId);
+
+        glLinkProgram(m_Id);   // links the shader program
+        // check for linking errors
+        glGetProgramiv(m_Id, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(m_Id, sizeof(infoLog), NULL, infoLog);
+            std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+
+            return false;
+        }
+
+        // The program keeps the linked code
+        glDetachShader(m_Id, vertexShaderId);
+        glDetachShader(m_Id, fragmentShaderId);
+        glDeleteShader(vertexShaderId);
+        glDeleteShader(fragmentShaderId);
+
+        reflect();
+
+        glUseProgram(m_Id);    // Uses the shader program
+
+        return true;
+    }
+
+    void destroy()
+    {
+        glDeleteProgram(m_Id);
+        m_Id = 0;
+    }
+
+    GLuint id() const { return m_Id; }
+
+    void use() const
+    {
+        glUseProgram(m_Id);
+    }
+
+    // Location of a slot, -1 if the program does not use it
+    GLint location(Uniform uniform) const { return m_Locations[uniform]; }
+
+    const std::vector<Variable>& uniforms() const { return m_Uniforms; }
+    const std::vector<Variable>& attributes() const { return m_Attributes; }
+    const std::vector<Variable>& blocks() const { return m_Blocks; }
+
+    // Reflected uniform block by name, nullptr if the program does not use it
+    const Variable* block(const char* name) const
+    {
+        for (const Variable& block : m_Blocks)
+        {
+            if (block.name == name)
+                return &block;
+        }
+        return nullptr;
+    }
+
+    void set(Uniform uniform, const glm::mat4& value)
+    {
+        if (changed(uniform, &value, sizeof(value)))
+            glProgramUniformMatrix4fv(m_Id, m_Locations[uniform], 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    void set(Uniform uniform, const glm::vec3& value)
+    {
+        if (changed(uniform, &value, sizeof(value)))
+            glProgramUniform3fv(m_Id, m_Locations[uniform], 1, glm::value_ptr(value));
+    }
+
+    void set(Uniform uniform, const glm::vec2& value)
+    {
+        if (changed(uniform, &value, sizeof(value)))
+            glProgramUniform2fv(m_Id, m_Locations[uniform], 1, glm::value_ptr(value));
+    }
+
+    void set(Uniform uniform, const glm::ivec2& value)
+    {
+        if (changed(uniform, &value, sizeof(value)))
+            glProgramUniform2i(m_Id, m_Locations[uniform], value.x, value.y);
+    }
+
+    // Also for bools and samplers
+    void set(Uniform uniform, GLint value)
+    {
+        if (changed(uniform, &value, sizeof(value)))
+            glProgramUniform1i(m_Id, m_Locations[uniform], value);
+    }
+
+    // Print what reflection found
+    void report(const char* name) const
+    {
+        std::cout << "INFO: Shader program " << name << ": " << m_Uniforms.size() << " uniforms, " << m_Attributes.size() << " attributes, "
+                  << m_Blocks.size() << " uniform blocks" << std::endl;
+        for (const Variable& uniform : m_Uniforms)
+            std::cout << "  uniform " << uniform.name << " (type 0x" << std::hex << uniform.type << std::dec << ") at " << uniform.location << std::endl;
+        for (const Variable& attribute : m_Attributes)
+            std::cout << "  attribute " << attribute.name << " (type 0x" << std::hex << attribute.type << std::dec << ") at " << attribute.location << std::endl;
+        for (const Variable& block : m_Blocks)
+        {
+            GLint binding = 0;
+            glGetActiveUniformBlockiv(m_Id, (GLuint)block.location, GL_UNIFORM_BLOCK_BINDING, &binding);
+            std::cout << "  block " << block.name << " (" << block.size << " bytes) at binding " << binding << std::endl;
+        }
+        for (int slot = 0; slot < UniformCount; ++slot)
+        {
+            if (m_Locations[slot] < 0)
+                std::cout << "  " << uniformName(slot) << " is not used" << std::endl;
+        }
+    }
+
+    static Stats& stats()
+    {
+        static Stats s_Stats;
+        return s_Stats;
+    }
+
+private:
+    // GLSL name of a Uniform slot
+    static const char* uniformName(int slot)
+    {
+        static const char* const s_Names[UniformCount] =
+        {
+            "model", "objectColor", "uvScale", "uTexture", "uTextureArray", "textureLayered", "sphereTessellation"
+        };
+        return s_Names[slot];
+    }
+
+    // Bytes of the largest uniform type set(): a mat4
+    static const size_t k_MaxValueBytes = sizeof(glm::mat4);
+
+    // Enumerate the active uniforms, attributes and blocks and map the slots to locations
+    void reflect()
+    {
+        m_Uniforms.clear();
+        m_Attributes.clear();
+        m_Blocks.clear();
+        char name[256];
+
+        GLint count = 0;
+        glGetProgramiv(m_Id, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            Variable uniform;
+            GLsizei length = 0;
+            glGetActiveUniform(m_Id, (GLuint)i, sizeof(name), &length, &uniform.size, &uniform.type, name);
+            uniform.name.assign(name, length);
+            uniform.location = glGetUniformLocation(m_Id, name);
+            m_Uniforms.push_back(uniform);
+        }
+
+        glGetProgramiv(m_Id, GL_ACTIVE_ATTRIBUTES, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            Variable attribute;
+            GLsizei length = 0;
+            glGetActiveAttrib(m_Id, (GLuint)i, sizeof(name), &length, &attribute.size, &attribute.type, name);
+            attribute.name.assign(name, length);
+            attribute.location = glGetAttribLocation(m_Id, name);
+            m_Attributes.push_back(attribute);
+        }
+
+        glGetProgramiv(m_Id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            Variable block;
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(m_Id, (GLuint)i, sizeof(name), &length, name);
+            block.name.assign(name, length);
+            glGetActiveUniformBlockiv(m_Id, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.size);
+            block.location = i;
+            m_Blocks.push_back(block);
+        }
+
+        for (int slot = 0; slot < UniformCount; ++slot)
+        {
+            m_Locations[slot] = -1;
+            m_Cached[slot] = false;
+            for (const Variable& uniform : m_Uniforms)
+            {
+                // Arrays are reported as "name[0]"
+                if (uniform.name.compare(0, uniform.name.find('['), uniformName(slot)) == 0)
+                    m_Locations[slot] = uniform.location;
+            }
+        }
+    }
+
+    // Whether a slot needs an upload, remembering the value if so; unused slots never do
+    bool changed(Uniform uniform, const void* value, size_t size)
+    {
+        if (m_Locations[uniform] < 0)
+            return false;
+        if (m_Cached[uniform] && std::memcmp(m_Values[uniform], value, size) == 0)
+        {
+            ++stats().skipped;
+            return false;
+        }
+        std::memcpy(m_Values[uniform], value, size);
+        m_Cached[uniform] = true;
+        ++stats().uploads;
+        return true;
+    }
+
+    GLuint m_Id = 0;
+    std::vector<Variable> m_Uniforms;
+    std::vector<Variable> m_Attributes;
+    std::vector<Variable> m_Blocks;
+    GLint m_Locations[UniformCount] = {};
+    bool m_Cached[UniformCount] = {};
+    unsigned char m_Values[UniformCount][k_MaxValueBytes] = {};
+};
+
+#endif // SHADERPROGRAM_H
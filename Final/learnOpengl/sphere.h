@@ -1,34 +1,91 @@
 #ifndef SPHERE_H
 #define SPHERE_H
 
-#include "object.h"
+#include "renderqueue.h"   // Object and the draws it queues
+#include "meshregistry.h"
 #include <string>
-#include <stdexcept>
 
 class Sphere : public Object
 {
 public:
     // Constructor that accepts a std::string
-    Sphere(const std::string& texturePath)
+    Sphere(const std::string& texturePath) : m_TexturePath(texturePath)
     {
-        initializeSphere(texturePath.c_str());
     }
 
     // Constructor that accepts a const char*
-    Sphere(const char* texturePath)
+    Sphere(const char* texturePath) : m_TexturePath(texturePath)
     {
-        initializeSphere(texturePath);
     }
 
-    // Initialize textures, vertices, etc.
-    virtual bool initialize() override
+    // Constructor with a tessellation other than the default 200x200
+    Sphere(const char* texturePath, std::uint32_t stacks, std::uint32_t sectors)
+        : m_TexturePath(texturePath), m_Stacks(stacks), m_Sectors(sectors)
     {
-        // Initialization code if needed
+    }
+
+    virtual ~Sphere()
+    {
+        if (m_ProceduralMesh.vao)
+            glDeleteVertexArrays(1, &m_ProceduralMesh.vao);
+    }
+
+    // Draw spheres from gl_VertexID alone, with no vertex or index buffer; set before load()
+    static bool& procedural()
+    {
+        static bool s_Procedural = false;
+        return s_Procedural;
+    }
+
+    // Generate the mesh and decode the texture
+    virtual bool load() override
+    {
+        // Shared meshes, every sphere uses the same VBOs; procedural spheres need none
+        if (procedural())
+        {
+            // Nothing to generate
+        }
+        else if (m_Stacks == 200 && m_Sectors == 200)
+        {
+            // Coarser levels for when the ball only covers a few pixels
+            m_MeshRequests.push_back(MeshRegistry::generateSphere<200, 200>(0.5f));
+            m_MeshRequests.push_back(MeshRegistry::generateSphere<100, 100>(0.5f));
+            m_MeshRequests.push_back(MeshRegistry::generateSphere<48, 48>(0.5f));
+            m_MeshRequests.push_back(MeshRegistry::generateSphere<16, 16>(0.5f));
+        }
+        else
+        {
+            m_MeshRequests.push_back(MeshRegistry::generateSphere(0.5f, m_Stacks, m_Sectors));
+        }
+
+        if (!loadTextureImage(m_TexturePath.c_str()))
+        {
+            std::cout << "WARNING: Failed to load texture: " << m_TexturePath << std::endl;
+            return false;
+        }
         return true;
     }
 
+    // Upload the mesh and texture
+    virtual bool upload() override
+    {
+        if (procedural())
+        {
+            // Core profile draws need a VAO, even one without attributes
+            glGenVertexArrays(1, &m_ProceduralMesh.vao);
+            m_ProceduralMesh.indices = 0;
+        }
+        else
+        {
+            m_Lods.push_back(MeshRegistry::uploadLod(m_MeshRequests));
+            m_MeshRequests.clear();
+        }
+
+        return uploadImages();
+    }
+
     // Draw
-    virtual void draw(GLint modelHandle) override
+    virtual void draw(RenderQueue& queue, ShaderProgram& program) override
     {
         glm::mat4 scale = glm::scale(glm::vec3(m_Scale.x, m_Scale.y, m_Scale.z));
         glm::mat4 rotation = glm::rotate(m_Rotation.z, glm::vec3(0.0f, 0.0f, 1.0f)) *
@@ -36,18 +93,22 @@ public:
             glm::rotate(m_Rotation.x, glm::vec3(0.0f, 1.0f, 0.0f));
         glm::mat4 translation = glm::translate(glm::vec3(m_Position.x, m_Position.y, m_Position.z));
 
-        // Activate the VBOs contained within the mesh's VAO
-        glBindVertexArray(m_Meshes[0].vao);
+        // A ball whose texture failed to load is left out
+        if (m_Textures.empty())
+            return;
 
-        // Bind the face color
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_Textures[0]);
-
-        glm::mat4 model = translation * rotation * scale;
-        glUniformMatrix4fv(modelHandle, 1, GL_FALSE, glm::value_ptr(model));
+        // Level of detail for the ball's size on screen
+        float radius = 0.5f * std::max(m_Scale.x, std::max(m_Scale.y, m_Scale.z));
+        if (procedural())
+        {
+            drawProcedural(queue, program, translation * rotation * scale, radius);
+            return;
+        }
+        const GLMesh& mesh = selectLod(m_Lods[0], m_Position, radius);
+        glm::mat4 model = translation * rotation * scale * meshTransform(mesh);
 
-        // Draw the triangles
-        glDrawArrays(GL_TRIANGLES, 0, m_Meshes[0].vertices);
+        // Draw the triangles, less the clusters that cannot be seen
+        queue.add(program, mesh, m_Textures[0], model).clusterCulling = true;
     }
 
     // Update based on fps
@@ -57,20 +118,41 @@ public:
     }
 
 private:
-    // Helper function to initialize the sphere
-    void initializeSphere(const char* texturePath)
-    {
-        // Create mesh
-        m_Meshes.push_back(makeSphere(0.5, 200, 200));
+    // Smallest procedural tessellation, in sectors, and the step it changes by
+    static const std::uint32_t k_MinProceduralSectors = 16;
+    static const std::uint32_t k_ProceduralSectorStep = 4;
 
-        GLuint textureId;
-        if (!createTexture(texturePath, textureId))
+    // Draw the sphere from gl_VertexID: the vertex shader rebuilds each vertex of
+    // Tessellation::fillSphere's triangles from the sphereTessellation uniform
+    void drawProcedural(RenderQueue& queue, ShaderProgram& program, const glm::mat4& transform, float radius)
+    {
+        // Enough sectors that no silhouette edge is longer than k_LodEdgePixels, the inverse of lodThresholds()
+        std::uint32_t sectors = m_Sectors;
+        std::uint32_t stacks = m_Stacks;
+        if (gLodEnabled)
         {
-            // Handle texture loading error
-            throw std::runtime_error(std::string("Failed to load texture: ") + texturePath);
+            float pixels = projectedRadius(m_Position, radius);
+            float needed = std::min(pixels * 2.0f * k_PI / k_LodEdgePixels, (float)m_Sectors);
+            std::uint32_t minSectors = k_MinProceduralSectors;  // std::max takes references, which would need a definition of the member
+            sectors = std::max(minSectors, ((std::uint32_t)needed + k_ProceduralSectorStep - 1) / k_ProceduralSectorStep * k_ProceduralSectorStep);
+            sectors = std::min(sectors, m_Sectors);
+            stacks = std::max(2u, sectors * m_Stacks / m_Sectors);
         }
-        m_Textures.push_back(textureId);
+
+        // Every quad is two triangles of its own; the pole quads draw one of them with zero area
+        m_ProceduralMesh.vertices = 6 * stacks * sectors;
+        m_ProceduralMesh.triangles = 2 * stacks * sectors;
+
+        // The shader builds a unit sphere
+        glm::mat4 model = transform * glm::scale(glm::vec3(0.5f));
+        queue.add(program, m_ProceduralMesh, m_Textures[0], model).sphereTessellation = glm::ivec2(stacks, sectors);
     }
+
+    std::string m_TexturePath;
+    std::uint32_t m_Stacks = 200;
+    std::uint32_t m_Sectors = 200;
+    std::vector<MeshRegistry::Request> m_MeshRequests;  // Finest level first
+    GLMesh m_ProceduralMesh = {};                       // Empty VAO and the vertex count of the current tessellation
 };
 
 #endif // SPHERE_H
@@ -0,0 +1,603 @@
+#ifndef TESSELLATION_H
+#define TESSELLATION_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "tessellationsimd.h"   // SSE2/AVX2 kernels with runtime dispatch
+
+// CPU side of the procedural primitives: vertex/index counts, sine and cosine
+// tables and the loops that fill interleaved position/normal/UV buffers.
+// Nothing here touches OpenGL, so it can run on any thread.
+namespace Tessellation
+{
+    const std::uint32_t k_FloatsPerVertex = 8;  // position, normal, UV
+    constexpr double k_PiD = 3.14159265358979323846;
+
+    // Taylor series sine, usable in constant expressions
+    constexpr double constSin(double x)
+    {
+        // Reduce to [-pi, pi] where 15 terms are exact to double precision
+        while (x > k_PiD) x -= 2 * k_PiD;
+        while (x < -k_PiD) x += 2 * k_PiD;
+
+        double term = x;
+        double sum = x;
+        for (int n = 1; n < 15; ++n)
+        {
+            term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr double constCos(double x)
+    {
+        return constSin(x + k_PiD / 2);
+    }
+
+    // Cosines and sines of start + i * step for i in [0, N]
+    template <std::uint32_t N>
+    struct AngleTable
+    {
+        float cosines[N + 1];
+        float sines[N + 1];
+    };
+
+    template <std::uint32_t N>
+    constexpr AngleTable<N> makeAngleTable(double start, double step)
+    {
+        AngleTable<N> table{};
+        for (std::uint32_t i = 0; i <= N; ++i)
+        {
+            table.cosines[i] = (float)constCos(start + i * step);
+            table.sines[i] = (float)constSin(start + i * step);
+        }
+        return table;
+    }
+
+    // Runtime version of the same table, matching the original float math
+    inline void fillAngleTable(std::uint32_t n, float start, float step, std::vector<float>& cosines, std::vector<float>& sines)
+    {
+        cosines.resize(n + 1);
+        sines.resize(n + 1);
+        for (std::uint32_t i = Simd::angleTable(n + 1, start, step, cosines.data(), sines.data()); i <= n; ++i)
+        {
+            float angle = start + i * step;
+            cosines[i] = std::cos(angle);
+            sines[i] = std::sin(angle);
+        }
+    }
+
+    // Exact buffer sizes of each primitive
+    constexpr std::size_t sphereVertexCount(std::uint32_t stacks, std::uint32_t sectors)
+    {
+        return (std::size_t)(stacks + 1) * (sectors + 1);
+    }
+
+    constexpr std::size_t sphereIndexCount(std::uint32_t stacks, std::uint32_t sectors)
+    {
+        // The first and last stacks are a single triangle per sector
+        return (std::size_t)6 * sectors * (stacks - 1);
+    }
+
+    constexpr std::size_t cylinderVertexCount(std::uint32_t sectors)
+    {
+        return (std::size_t)4 * sectors + 2 * (sectors + 1);
+    }
+
+    constexpr std::size_t cylinderIndexCount(std::uint32_t sectors)
+    {
+        return (std::size_t)12 * sectors;
+    }
+
+    constexpr std::size_t coneVertexCount(std::uint32_t sectors)
+    {
+        return (std::size_t)3 * sectors + (sectors + 1);
+    }
+
+    constexpr std::size_t coneIndexCount(std::uint32_t sectors)
+    {
+        return (std::size_t)6 * sectors;
+    }
+
+    // Vertex and index storage whose size is fixed at compile time
+    template <std::size_t Vertices, std::size_t Indices>
+    struct FixedGeometry
+    {
+        float vertices[Vertices * k_FloatsPerVertex];
+        std::uint32_t indices[Indices];
+    };
+
+    // How the indices make triangles
+    enum class Topology
+    {
+        Triangles,  // Three indices per triangle
+        Strips      // Triangle strips separated by k_RestartIndex
+    };
+
+    // Primitive restart index for 32-bit indices, the fixed one GL_PRIMITIVE_RESTART_FIXED_INDEX uses
+    const std::uint32_t k_RestartIndex = 0xFFFFFFFFu;
+
+    // A run of triangles in a mesh's index buffer that is culled as a unit
+    struct Cluster
+    {
+        std::uint32_t firstIndex;   // Into the mesh's indices
+        std::uint32_t indexCount;
+        float center[3];            // Bounding sphere
+        float radius;
+        float coneAxis[3];          // Backface cone: the average facing and how far the triangles spread from it
+        float coneCutoff;           // 1 when the cone is too wide to ever cull
+    };
+
+    // Vertex and index storage sized at runtime
+    struct Geometry
+    {
+        std::vector<float> vertices;
+        std::vector<std::uint32_t> indices;
+        Topology topology = Topology::Triangles;
+        std::vector<Cluster> clusters;  // Empty unless the mesh is large enough to cull in parts
+    };
+
+    // Either kind of geometry behind one type, for code that only needs the arrays
+    struct MeshData
+    {
+        const float* vertices = nullptr;
+        std::size_t vertexBytes = 0;
+        const std::uint32_t* indices = nullptr;
+        std::size_t indexCount = 0;
+        Topology topology = Topology::Triangles;
+        const Cluster* clusters = nullptr;
+        std::size_t clusterCount = 0;
+        std::shared_ptr<const void> storage;    // Owns the arrays above
+    };
+
+    inline std::shared_ptr<const MeshData> share(Geometry geometry)
+    {
+        auto owned = std::make_shared<const Geometry>(std::move(geometry));
+        auto data = std::make_shared<MeshData>();
+        data->vertices = owned->vertices.data();
+        data->vertexBytes = owned->vertices.size() * sizeof(float);
+        data->indices = owned->indices.data();
+        data->indexCount = owned->indices.size();
+        data->topology = owned->topology;
+        data->clusters = owned->clusters.data();
+        data->clusterCount = owned->clusters.size();
+        data->storage = owned;
+        return data;
+    }
+
+    template <std::size_t Vertices, std::size_t Indices>
+    std::shared_ptr<const MeshData> share(std::unique_ptr<FixedGeometry<Vertices, Indices>> geometry)
+    {
+        std::shared_ptr<const FixedGeometry<Vertices, Indices>> owned(std::move(geometry));
+        auto data = std::make_shared<MeshData>();
+        data->vertices = owned->vertices;
+        data->vertexBytes = sizeof(owned->vertices);
+        data->indices = owned->indices;
+        data->indexCount = Indices;
+        data->storage = owned;
+        return data;
+    }
+
+    // Write one interleaved position/normal/UV vertex and advance the cursor
+    inline void writeVertex(float*& out, float x, float y, float z, float nx, float ny, float nz, float s, float t)
+    {
+        out[0] = x;
+        out[1] = y;
+        out[2] = z;
+        out[3] = nx;
+        out[4] = ny;
+        out[5] = nz;
+        out[6] = s;
+        out[7] = t;
+        out += k_FloatsPerVertex;
+    }
+
+    // Write three indices and advance the cursor
+    inline void writeTriangle(std::uint32_t*& out, std::uint32_t a, std::uint32_t b, std::uint32_t c)
+    {
+        out[0] = a;
+        out[1] = b;
+        out[2] = c;
+        out += 3;
+    }
+
+    // Flat disc at height h, fanned around a center vertex written after the ring
+    inline void fillCap(float radius, float h, float nz, std::uint32_t sectors, const float* cosines, const float* sines,
+                        float*& v, std::uint32_t*& ix, std::uint32_t base)
+    {
+        const Simd::RingVertex ring = { h, 0, nz, 0, 0, 1, 1, 0 };
+        std::uint32_t j = Simd::ring(sectors, radius, ring, cosines, sines, v, k_FloatsPerVertex);
+        v += j * k_FloatsPerVertex;
+        for (; j < sectors; ++j)
+        {
+            float ux = cosines[j];
+            float uy = sines[j];
+            writeVertex(v, ux * radius, uy * radius, h, 0, 0, nz, -ux * 0.5f + 0.5f, -uy * 0.5f + 0.5f);
+        }
+
+        // Center vertex
+        std::uint32_t center = base + sectors;
+        writeVertex(v, 0, 0, h, 0, 0, nz, 0.5f, 0.5f);
+
+        for (std::uint32_t j = 0; j < sectors; ++j)
+        {
+            writeTriangle(ix, base + j, base + (j + 1) % sectors, center);
+        }
+    }
+
+    // Sphere from stack angle (pi/2 down to -pi/2) and sector angle (0 to 2pi) tables
+    inline void fillSphere(float radius, std::uint32_t stacks, std::uint32_t sectors,
+                           const float* stackCosines, const float* stackSines,
+                           const float* sectorCosines, const float* sectorSines,
+                           float* vertices, std::uint32_t* indices)
+    {
+        float lengthInv = 1.0f / radius;
+        float* v = vertices;
+        for (std::uint32_t i = 0; i <= stacks; ++i)
+        {
+            float xy = radius * stackCosines[i];
+            float z = radius * stackSines[i];
+
+            std::uint32_t j = Simd::sphereRow(sectors, xy, z, lengthInv, (float)i / stacks, sectorCosines, sectorSines, v);
+            v += j * k_FloatsPerVertex;
+            for (; j <= sectors; ++j)
+            {
+                float x = xy * sectorCosines[j];
+                float y = xy * sectorSines[j];
+                writeVertex(v, x, y, z, x * lengthInv, y * lengthInv, z * lengthInv, (float)j / sectors, (float)i / stacks);
+            }
+        }
+
+        std::uint32_t* ix = indices;
+        for (std::uint32_t i = 0; i < stacks; ++i)
+        {
+            std::uint32_t k1 = i * (sectors + 1);     // beginning of current stack
+            std::uint32_t k2 = k1 + sectors + 1;      // beginning of next stack
+
+            for (std::uint32_t j = 0; j < sectors; ++j, ++k1, ++k2)
+            {
+                if (i != 0)
+                    writeTriangle(ix, k1, k2, k1 + 1);
+
+                if (i != (stacks - 1))
+                    writeTriangle(ix, k1 + 1, k2, k2 + 1);
+            }
+        }
+    }
+
+    // Cylinder along z from a unit circle table of sectors + 1 entries
+    inline void fillCylinder(float radius, float height, std::uint32_t sectors, const float* cosines, const float* sines,
+                             float* vertices, std::uint32_t* indices)
+    {
+        float* v = vertices;
+        std::uint32_t* ix = indices;
+
+        // Sides of cylinder, one quad per sector with the texture stretched across it
+        float h = height / 2.0f;
+        const Simd::RingVertex sides[4] =
+        {
+            { -h, 1, 0, 0, 0, 0, 1, 0 },
+            { -h, 1, 0, 0, 1, 0, 1, 1 },
+            { h, 1, 0, 1, 0, 0, 1, 0 },
+            { h, 1, 0, 1, 1, 0, 1, 1 }
+        };
+        std::uint32_t j = 0;
+        for (std::uint32_t k = 0; k < 4; ++k)
+        {
+            j = Simd::ring(sectors, radius, sides[k], cosines, sines, vertices + k * k_FloatsPerVertex, 4 * k_FloatsPerVertex);
+        }
+        v += j * 4 * k_FloatsPerVertex;
+
+        for (; j < sectors; ++j)
+        {
+            float ux0 = cosines[j];
+            float uy0 = sines[j];
+            float ux1 = cosines[j + 1];
+            float uy1 = sines[j + 1];
+
+            writeVertex(v, ux0 * radius, uy0 * radius, -h, ux0, uy0, 0, 0, 0);
+            writeVertex(v, ux1 * radius, uy1 * radius, -h, ux1, uy1, 0, 0, 1);
+            writeVertex(v, ux0 * radius, uy0 * radius, h, ux0, uy0, 0, 1, 0);
+            writeVertex(v, ux1 * radius, uy1 * radius, h, ux1, uy1, 0, 1, 1);
+        }
+
+        for (std::uint32_t j = 0; j < sectors; ++j)
+        {
+            std::uint32_t base = j * 4;
+            writeTriangle(ix, base, base + 1, base + 2);
+            writeTriangle(ix, base + 1, base + 3, base + 2);
+        }
+
+        // Bottom and top of cylinder
+        for (std::uint32_t i = 0; i < 2; ++i)
+        {
+            std::uint32_t base = 4 * sectors + i * (sectors + 1);
+            fillCap(radius, -h + i * height, -1.0f * i, sectors, cosines, sines, v, ix, base);
+        }
+    }
+
+    // Cone along z, point at -height/2, from a unit circle table of sectors + 1 entries
+    inline void fillCone(float radius, float height, std::uint32_t sectors, const float* cosines, const float* sines,
+                         float* vertices, std::uint32_t* indices)
+    {
+        float* v = vertices;
+        std::uint32_t* ix = indices;
+
+        // Sides of cone, one triangle per sector from the base ring to the point
+        float h = height / 2.0f;
+        const Simd::RingVertex sides[3] =
+        {
+            { h, 1, 0, 0, 0, 0, 1, 0 },
+            { h, 1, 0, 0, 1, 0, 1, 1 },
+            { -h, 1, 0, 1, 0, 0, 0, 0 }
+        };
+        std::uint32_t j = 0;
+        for (std::uint32_t k = 0; k < 3; ++k)
+        {
+            j = Simd::ring(sectors, radius, sides[k], cosines, sines, vertices + k * k_FloatsPerVertex, 3 * k_FloatsPerVertex);
+        }
+        v += j * 3 * k_FloatsPerVertex;
+
+        for (; j < sectors; ++j)
+        {
+            float ux0 = cosines[j];
+            float uy0 = sines[j];
+            float ux1 = cosines[j + 1];
+            float uy1 = sines[j + 1];
+
+            writeVertex(v, ux0 * radius, uy0 * radius, h, ux0, uy0, 0, 0, 0);
+            writeVertex(v, ux1 * radius, uy1 * radius, h, ux1, uy1, 0, 0, 1);
+            writeVertex(v, 0, 0, -h, ux0, uy0, 0, 1, 0);
+        }
+
+        for (std::uint32_t j = 0; j < sectors; ++j)
+        {
+            std::uint32_t base = j * 3;
+            writeTriangle(ix, base, base + 1, base + 2);
+        }
+
+        // Base of cone
+        fillCap(radius, h, 1.0f, sectors, cosines, sines, v, ix, 3 * sectors);
+    }
+
+    // Strip indices over the same vertices as the triangle lists above. Sphere
+    // stacks are one strip each; the pole stacks keep their zero area triangles.
+    // Cylinder side quads carry their own UVs, so each is a strip of its own, and
+    // cone sides stay single triangles. Caps become a zigzag across the ring,
+    // which covers the same flat disc without the center vertex.
+    constexpr std::size_t sphereStripIndexCount(std::uint32_t stacks, std::uint32_t sectors)
+    {
+        return (std::size_t)stacks * (2 * (sectors + 1) + 1) - 1;
+    }
+
+    constexpr std::size_t cylinderStripIndexCount(std::uint32_t sectors)
+    {
+        // Side quads and two caps, with a restart between each
+        return (std::size_t)4 * sectors + 2 * sectors + (sectors + 2) - 1;
+    }
+
+    constexpr std::size_t coneStripIndexCount(std::uint32_t sectors)
+    {
+        return (std::size_t)3 * sectors + sectors + (sectors + 1) - 1;
+    }
+
+    inline void writeRestart(std::uint32_t*& out)
+    {
+        *out++ = k_RestartIndex;
+    }
+
+    // Zigzag strip over a convex ring of vertices: 0, 1, n-1, 2, n-2, ...
+    inline void writeCapStrip(std::uint32_t*& out, std::uint32_t base, std::uint32_t sectors)
+    {
+        std::uint32_t low = 1;
+        std::uint32_t high = sectors - 1;
+        *out++ = base;
+        while (low <= high)
+        {
+            *out++ = base + low++;
+            if (low <= high)
+                *out++ = base + high--;
+        }
+    }
+
+    inline void fillSphereStrips(std::uint32_t stacks, std::uint32_t sectors, std::uint32_t* indices)
+    {
+        std::uint32_t* ix = indices;
+        for (std::uint32_t i = 0; i < stacks; ++i)
+        {
+            if (i != 0)
+                writeRestart(ix);
+
+            std::uint32_t k1 = i * (sectors + 1);
+            std::uint32_t k2 = k1 + sectors + 1;
+            for (std::uint32_t j = 0; j <= sectors; ++j)
+            {
+                *ix++ = k1 + j;
+                *ix++ = k2 + j;
+            }
+        }
+    }
+
+    inline void fillCylinderStrips(std::uint32_t sectors, std::uint32_t* indices)
+    {
+        std::uint32_t* ix = indices;
+        for (std::uint32_t j = 0; j < sectors; ++j)
+        {
+            std::uint32_t base = j * 4;
+            for (std::uint32_t k = 0; k < 4; ++k)
+                *ix++ = base + k;
+            writeRestart(ix);
+        }
+
+        writeCapStrip(ix, 4 * sectors, sectors);
+        writeRestart(ix);
+        writeCapStrip(ix, 4 * sectors + sectors + 1, sectors);
+    }
+
+    inline void fillConeStrips(std::uint32_t sectors, std::uint32_t* indices)
+    {
+        std::uint32_t* ix = indices;
+        for (std::uint32_t j = 0; j < sectors; ++j)
+        {
+            std::uint32_t base = j * 3;
+            for (std::uint32_t k = 0; k < 3; ++k)
+                *ix++ = base + k;
+            writeRestart(ix);
+        }
+
+        writeCapStrip(ix, 3 * sectors, sectors);
+    }
+
+    // Triangles drawn by strip indices, degenerate ones included
+    inline std::size_t stripTriangleCount(const std::uint32_t* indices, std::size_t indexCount)
+    {
+        std::size_t triangles = 0;
+        std::size_t run = 0;
+        for (std::size_t i = 0; i <= indexCount; ++i)
+        {
+            if (i == indexCount || indices[i] == k_RestartIndex)
+            {
+                triangles += run >= 3 ? run - 2 : 0;
+                run = 0;
+            }
+            else
+            {
+                ++run;
+            }
+        }
+        return triangles;
+    }
+
+    // Runtime-parameter writers: trig evaluated per call, output written to
+    // caller storage of the exact *VertexCount/*IndexCount size, such as a mapped GL buffer
+    inline void writeSphere(float radius, std::uint32_t stacks, std::uint32_t sectors, float* vertices, std::uint32_t* indices)
+    {
+        std::vector<float> stackCosines, stackSines, sectorCosines, sectorSines;
+        fillAngleTable(stacks, (float)(k_PiD / 2), -(float)k_PiD / stacks, stackCosines, stackSines);
+        fillAngleTable(sectors, 0, 2 * (float)k_PiD / sectors, sectorCosines, sectorSines);
+        fillSphere(radius, stacks, sectors, stackCosines.data(), stackSines.data(), sectorCosines.data(), sectorSines.data(), vertices, indices);
+    }
+
+    inline void writeCylinder(float radius, float height, std::uint32_t sectors, float* vertices, std::uint32_t* indices)
+    {
+        std::vector<float> cosines, sines;
+        fillAngleTable(sectors, 0, 2 * (float)k_PiD / sectors, cosines, sines);
+        fillCylinder(radius, height, sectors, cosines.data(), sines.data(), vertices, indices);
+    }
+
+    inline void writeCone(float radius, float height, std::uint32_t sectors, float* vertices, std::uint32_t* indices)
+    {
+        std::vector<float> cosines, sines;
+        fillAngleTable(sectors, 0, 2 * (float)k_PiD / sectors, cosines, sines);
+        fillCone(radius, height, sectors, cosines.data(), sines.data(), vertices, indices);
+    }
+
+    // Runtime-parameter builders: the writers above into buffers sized per call
+    inline Geometry buildSphere(float radius, std::uint32_t stacks, std::uint32_t sectors)
+    {
+        Geometry geometry;
+        geometry.vertices.resize(sphereVertexCount(stacks, sectors) * k_FloatsPerVertex);
+        geometry.indices.resize(sphereIndexCount(stacks, sectors));
+        writeSphere(radius, stacks, sectors, geometry.vertices.data(), geometry.indices.data());
+        return geometry;
+    }
+
+    inline Geometry buildCylinder(float radius, float height, std::uint32_t sectors)
+    {
+        Geometry geometry;
+        geometry.vertices.resize(cylinderVertexCount(sectors) * k_FloatsPerVertex);
+        geometry.indices.resize(cylinderIndexCount(sectors));
+        writeCylinder(radius, height, sectors, geometry.vertices.data(), geometry.indices.data());
+        return geometry;
+    }
+
+    inline Geometry buildCone(float radius, float height, std::uint32_t sectors)
+    {
+        Geometry geometry;
+        geometry.vertices.resize(coneVertexCount(sectors) * k_FloatsPerVertex);
+        geometry.indices.resize(coneIndexCount(sectors));
+        writeCone(radius, height, sectors, geometry.vertices.data(), geometry.indices.data());
+        return geometry;
+    }
+
+    // Strip versions of the builders: same vertices, strip indices
+    inline Geometry buildSphereStrips(float radius, std::uint32_t stacks, std::uint32_t sectors)
+    {
+        Geometry geometry = buildSphere(radius, stacks, sectors);
+        geometry.indices.resize(sphereStripIndexCount(stacks, sectors));
+        fillSphereStrips(stacks, sectors, geometry.indices.data());
+        geometry.topology = Topology::Strips;
+        return geometry;
+    }
+
+    inline Geometry buildCylinderStrips(float radius, float height, std::uint32_t sectors)
+    {
+        Geometry geometry = buildCylinder(radius, height, sectors);
+        geometry.indices.resize(cylinderStripIndexCount(sectors));
+        fillCylinderStrips(sectors, geometry.indices.data());
+        geometry.topology = Topology::Strips;
+        return geometry;
+    }
+
+    inline Geometry buildConeStrips(float radius, float height, std::uint32_t sectors)
+    {
+        Geometry geometry = buildCone(radius, height, sectors);
+        geometry.indices.resize(coneStripIndexCount(sectors));
+        fillConeStrips(sectors, geometry.indices.data());
+        geometry.topology = Topology::Strips;
+        return geometry;
+    }
+
+    // Compile-time specialized builders: trig tables are constants and the
+    // output is a single allocation of exactly the right size
+    template <std::uint32_t Stacks, std::uint32_t Sectors>
+    using SphereGeometry = FixedGeometry<sphereVertexCount(Stacks, Sectors), sphereIndexCount(Stacks, Sectors)>;
+
+    template <std::uint32_t Sectors>
+    using CylinderGeometry = FixedGeometry<cylinderVertexCount(Sectors), cylinderIndexCount(Sectors)>;
+
+    template <std::uint32_t Sectors>
+    using ConeGeometry = FixedGeometry<coneVertexCount(Sectors), coneIndexCount(Sectors)>;
+
+    template <std::uint32_t Stacks, std::uint32_t Sectors>
+    std::unique_ptr<SphereGeometry<Stacks, Sectors>> buildSphere(float radius)
+    {
+        static_assert(Stacks >= 2 && Sectors >= 3, "Sphere needs at least 2 stacks and 3 sectors");
+        static constexpr AngleTable<Stacks> stackTable = makeAngleTable<Stacks>(k_PiD / 2, -k_PiD / Stacks);
+        static constexpr AngleTable<Sectors> sectorTable = makeAngleTable<Sectors>(0, 2 * k_PiD / Sectors);
+
+        std::unique_ptr<SphereGeometry<Stacks, Sectors>> geometry(new SphereGeometry<Stacks, Sectors>);
+        fillSphere(radius, Stacks, Sectors, stackTable.cosines, stackTable.sines, sectorTable.cosines, sectorTable.sines,
+                   geometry->vertices, geometry->indices);
+        return geometry;
+    }
+
+    template <std::uint32_t Sectors>
+    std::unique_ptr<CylinderGeometry<Sectors>> buildCylinder(float radius, float height)
+    {
+        static_assert(Sectors >= 3, "Cylinder needs at least 3 sectors");
+        static constexpr AngleTable<Sectors> table = makeAngleTable<Sectors>(0, 2 * k_PiD / Sectors);
+
+        std::unique_ptr<CylinderGeometry<Sectors>> geometry(new CylinderGeometry<Sectors>);
+        fillCylinder(radius, height, Sectors, table.cosines, table.sines, geometry->vertices, geometry->indices);
+        return geometry;
+    }
+
+    template <std::uint32_t Sectors>
+    std::unique_ptr<ConeGeometry<Sectors>> buildCone(float radius, float height)
+    {
+        static_assert(Sectors >= 3, "Cone needs at least 3 sectors");
+        static constexpr AngleTable<Sectors> table = makeAngleTable<Sectors>(0, 2 * k_PiD / Sectors);
+
+        std::unique_ptr<ConeGeometry<Sectors>> geometry(new ConeGeometry<Sectors>);
+        fillCone(radius, height, Sectors, table.cosines, table.sines, geometry->vertices, geometry->indices);
+        return geometry;
+    }
+}
+
+#endif // TESSELLATION_H
@@ -0,0 +1,411 @@
+#ifndef TESSELLATIONSIMD_H
+#define TESSELLATIONSIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TESSELLATION_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC compiles intrinsics for any instruction set; GCC/Clang need the target per function
+#if defined(TESSELLATION_X86) && !defined(_MSC_VER)
+#define TESSELLATION_SSE2 __attribute__((target("sse2")))
+#define TESSELLATION_AVX2 __attribute__((target("avx2")))
+#else
+#define TESSELLATION_SSE2
+#define TESSELLATION_AVX2
+#endif
+
+// SSE2/AVX2 kernels for the tessellation loops: vectorized sincos for the angle
+// tables, and 4 or 8 interleaved position/normal/UV vertices per iteration.
+// Every kernel returns how many table entries or vertices it wrote, a multiple
+// of the vector width and 0 when the active instruction set is scalar; the
+// caller finishes the remainder from that count with its own scalar loop.
+namespace Tessellation
+{
+namespace Simd
+{
+    enum class Isa { Scalar, SSE2, AVX2 };
+
+    inline Isa detectIsa()
+    {
+#if defined(TESSELLATION_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+
+        __cpuid(info, 1);
+        bool sse2 = (info[3] & (1 << 26)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+
+        bool avx2 = false;
+        if (maxLeaf >= 7 && osxsave && avx)
+        {
+            // The OS must also save the upper halves of the YMM registers
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0 && (_xgetbv(0) & 6) == 6;
+        }
+
+        if (avx2)
+            return Isa::AVX2;
+        if (sse2)
+            return Isa::SSE2;
+#elif defined(TESSELLATION_X86)
+        if (__builtin_cpu_supports("avx2"))
+            return Isa::AVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return Isa::SSE2;
+#endif
+        return Isa::Scalar;
+    }
+
+    // Instruction set used by the kernels; can be lowered to compare against the scalar path
+    inline Isa& activeIsa()
+    {
+        static Isa s_Isa = detectIsa();
+        return s_Isa;
+    }
+
+    inline const char* isaName(Isa isa)
+    {
+        switch (isa)
+        {
+        case Isa::AVX2: return "AVX2";
+        case Isa::SSE2: return "SSE2";
+        default:        return "scalar";
+        }
+    }
+
+#ifdef TESSELLATION_X86
+    // Cephes single precision sincos constants
+    const float k_FourOverPi = 1.27323954473516f;
+    const float k_DP1 = -0.78515625f;
+    const float k_DP2 = -2.4187564849853515625e-4f;
+    const float k_DP3 = -3.77489497744594108e-8f;
+    const float k_SinC0 = -1.9515295891e-4f;
+    const float k_SinC1 = 8.3321608736e-3f;
+    const float k_SinC2 = -1.6666654611e-1f;
+    const float k_CosC0 = 2.443315711809948e-5f;
+    const float k_CosC1 = -1.388731625493765e-3f;
+    const float k_CosC2 = 4.166664568298827e-2f;
+
+    // ---------------------------------------------------------------- SSE2
+
+    TESSELLATION_SSE2 inline void sincos4(__m128 x, __m128& s, __m128& c)
+    {
+        const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+        __m128 signSin = _mm_and_ps(x, signMask);
+        x = _mm_andnot_ps(signMask, x);
+
+        // Octant, rounded up to even
+        __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(k_FourOverPi)));
+        j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+        __m128 y = _mm_cvtepi32_ps(j);
+
+        __m128 swapSin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+        __m128i jc = _mm_sub_epi32(j, _mm_set1_epi32(2));
+        __m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(jc, _mm_set1_epi32(4)), 29));
+        __m128 polyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+        signSin = _mm_xor_ps(signSin, swapSin);
+
+        // Extended precision reduction into [-pi/4, pi/4]
+        x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(k_DP1)));
+        x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(k_DP2)));
+        x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(k_DP3)));
+        __m128 z = _mm_mul_ps(x, x);
+
+        __m128 pc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(k_CosC0), z), _mm_set1_ps(k_CosC1));
+        pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(k_CosC2));
+        pc = _mm_mul_ps(_mm_mul_ps(pc, z), z);
+        pc = _mm_sub_ps(pc, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+        pc = _mm_add_ps(pc, _mm_set1_ps(1.0f));
+
+        __m128 ps = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(k_SinC0), z), _mm_set1_ps(k_SinC1));
+        ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(k_SinC2));
+        ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), x), x);
+
+        s = _mm_or_ps(_mm_and_ps(polyMask, ps), _mm_andnot_ps(polyMask, pc));
+        c = _mm_or_ps(_mm_and_ps(polyMask, pc), _mm_andnot_ps(polyMask, ps));
+        s = _mm_xor_ps(s, signSin);
+        c = _mm_xor_ps(c, signCos);
+    }
+
+    // Transpose 8 attribute vectors of 4 vertices and store vertex k at out + k * stride
+    TESSELLATION_SSE2 inline void storeVertices4(float* out, std::size_t stride, __m128 a0, __m128 a1, __m128 a2, __m128 a3,
+                                                 __m128 a4, __m128 a5, __m128 a6, __m128 a7)
+    {
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(a4, a5, a6, a7);
+        _mm_storeu_ps(out, a0);
+        _mm_storeu_ps(out + 4, a4);
+        _mm_storeu_ps(out + stride, a1);
+        _mm_storeu_ps(out + stride + 4, a5);
+        _mm_storeu_ps(out + 2 * stride, a2);
+        _mm_storeu_ps(out + 2 * stride + 4, a6);
+        _mm_storeu_ps(out + 3 * stride, a3);
+        _mm_storeu_ps(out + 3 * stride + 4, a7);
+    }
+
+    TESSELLATION_SSE2 inline std::uint32_t angleTableSse2(std::uint32_t count, float start, float step, float* cosines, float* sines)
+    {
+        std::uint32_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 index = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32((int)i), _mm_setr_epi32(0, 1, 2, 3)));
+            __m128 s, c;
+            sincos4(_mm_add_ps(_mm_set1_ps(start), _mm_mul_ps(index, _mm_set1_ps(step))), s, c);
+            _mm_storeu_ps(cosines + i, c);
+            _mm_storeu_ps(sines + i, s);
+        }
+        return i;
+    }
+
+    TESSELLATION_SSE2 inline std::uint32_t sphereRowSse2(std::uint32_t sectors, float xy, float z, float lengthInv, float t,
+                                                         const float* cosines, const float* sines, float* v)
+    {
+        __m128 vxy = _mm_set1_ps(xy);
+        __m128 vz = _mm_set1_ps(z);
+        __m128 vnz = _mm_set1_ps(z * lengthInv);
+        __m128 vt = _mm_set1_ps(t);
+        __m128 vlengthInv = _mm_set1_ps(lengthInv);
+        __m128 vsectors = _mm_set1_ps((float)sectors);
+
+        std::uint32_t j = 0;
+        for (; j + 4 <= sectors + 1; j += 4)
+        {
+            __m128 x = _mm_mul_ps(vxy, _mm_loadu_ps(cosines + j));
+            __m128 y = _mm_mul_ps(vxy, _mm_loadu_ps(sines + j));
+            __m128 s = _mm_div_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32((int)j), _mm_setr_epi32(0, 1, 2, 3))), vsectors);
+            storeVertices4(v + j * 8, 8, x, y, vz, _mm_mul_ps(x, vlengthInv), _mm_mul_ps(y, vlengthInv), vnz, s, vt);
+        }
+        return j;
+    }
+
+    // One ring of lathe vertices: position on the circle at height h, normal (nx, ny, nz) or the circle direction, and UV
+    struct RingVertex
+    {
+        float h;            // z of the vertex
+        float radial;       // 1 to use the circle direction as the normal, 0 for (0, 0, nz)
+        float nz;
+        float s, t;         // Fixed UV, used when capUV is 0
+        float capUV;        // 1 to map the circle onto the texture like a disc
+        float onCircle;     // 0 collapses the position onto the axis
+        std::uint32_t next; // 1 to use the following table entry
+    };
+
+    TESSELLATION_SSE2 inline std::uint32_t ringSse2(std::uint32_t sectors, float radius, const RingVertex& ring,
+                                                    const float* cosines, const float* sines, float* v, std::size_t stride)
+    {
+        const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+        __m128 vradius = _mm_set1_ps(radius * ring.onCircle);
+        __m128 radial = _mm_castsi128_ps(_mm_set1_epi32(ring.radial != 0 ? -1 : 0));
+        __m128 capUV = _mm_castsi128_ps(_mm_set1_epi32(ring.capUV != 0 ? -1 : 0));
+        __m128 half = _mm_set1_ps(0.5f);
+
+        std::uint32_t j = 0;
+        for (; j + 4 <= sectors; j += 4)
+        {
+            __m128 ux = _mm_loadu_ps(cosines + j + ring.next);
+            __m128 uy = _mm_loadu_ps(sines + j + ring.next);
+            __m128 nx = _mm_and_ps(radial, ux);
+            __m128 ny = _mm_and_ps(radial, uy);
+            __m128 nz = _mm_andnot_ps(radial, _mm_set1_ps(ring.nz));
+            __m128 s = _mm_add_ps(_mm_mul_ps(_mm_xor_ps(ux, signMask), half), half);
+            __m128 t = _mm_add_ps(_mm_mul_ps(_mm_xor_ps(uy, signMask), half), half);
+            s = _mm_or_ps(_mm_and_ps(capUV, s), _mm_andnot_ps(capUV, _mm_set1_ps(ring.s)));
+            t = _mm_or_ps(_mm_and_ps(capUV, t), _mm_andnot_ps(capUV, _mm_set1_ps(ring.t)));
+            storeVertices4(v + j * stride, stride, _mm_mul_ps(ux, vradius), _mm_mul_ps(uy, vradius), _mm_set1_ps(ring.h),
+                           nx, ny, nz, s, t);
+        }
+        return j;
+    }
+
+    // ---------------------------------------------------------------- AVX2
+
+    TESSELLATION_AVX2 inline void sincos8(__m256 x, __m256& s, __m256& c)
+    {
+        const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+        __m256 signSin = _mm256_and_ps(x, signMask);
+        x = _mm256_andnot_ps(signMask, x);
+
+        // Octant, rounded up to even
+        __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(k_FourOverPi)));
+        j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+        __m256 y = _mm256_cvtepi32_ps(j);
+
+        __m256 swapSin = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+        __m256i jc = _mm256_sub_epi32(j, _mm256_set1_epi32(2));
+        __m256 signCos = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(jc, _mm256_set1_epi32(4)), 29));
+        __m256 polyMask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+        signSin = _mm256_xor_ps(signSin, swapSin);
+
+        // Extended precision reduction into [-pi/4, pi/4]
+        x = _mm256_add_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(k_DP1)));
+        x = _mm256_add_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(k_DP2)));
+        x = _mm256_add_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(k_DP3)));
+        __m256 z = _mm256_mul_ps(x, x);
+
+        __m256 pc = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(k_CosC0), z), _mm256_set1_ps(k_CosC1));
+        pc = _mm256_add_ps(_mm256_mul_ps(pc, z), _mm256_set1_ps(k_CosC2));
+        pc = _mm256_mul_ps(_mm256_mul_ps(pc, z), z);
+        pc = _mm256_sub_ps(pc, _mm256_mul_ps(z, _mm256_set1_ps(0.5f)));
+        pc = _mm256_add_ps(pc, _mm256_set1_ps(1.0f));
+
+        __m256 ps = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(k_SinC0), z), _mm256_set1_ps(k_SinC1));
+        ps = _mm256_add_ps(_mm256_mul_ps(ps, z), _mm256_set1_ps(k_SinC2));
+        ps = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ps, z), x), x);
+
+        s = _mm256_blendv_ps(pc, ps, polyMask);
+        c = _mm256_blendv_ps(ps, pc, polyMask);
+        s = _mm256_xor_ps(s, signSin);
+        c = _mm256_xor_ps(c, signCos);
+    }
+
+    // Transpose 8 attribute vectors of 8 vertices and store vertex k at out + k * stride
+    TESSELLATION_AVX2 inline void storeVertices8(float* out, std::size_t stride, __m256 a0, __m256 a1, __m256 a2, __m256 a3,
+                                                 __m256 a4, __m256 a5, __m256 a6, __m256 a7)
+    {
+        __m256 t0 = _mm256_unpacklo_ps(a0, a1);
+        __m256 t1 = _mm256_unpackhi_ps(a0, a1);
+        __m256 t2 = _mm256_unpacklo_ps(a2, a3);
+        __m256 t3 = _mm256_unpackhi_ps(a2, a3);
+        __m256 t4 = _mm256_unpacklo_ps(a4, a5);
+        __m256 t5 = _mm256_unpackhi_ps(a4, a5);
+        __m256 t6 = _mm256_unpacklo_ps(a6, a7);
+        __m256 t7 = _mm256_unpackhi_ps(a6, a7);
+
+        __m256 q0 = _mm256_shuffle_ps(t0, t2, 0x44);
+        __m256 q1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+        __m256 q2 = _mm256_shuffle_ps(t1, t3, 0x44);
+        __m256 q3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+        __m256 q4 = _mm256_shuffle_ps(t4, t6, 0x44);
+        __m256 q5 = _mm256_shuffle_ps(t4, t6, 0xEE);
+        __m256 q6 = _mm256_shuffle_ps(t5, t7, 0x44);
+        __m256 q7 = _mm256_shuffle_ps(t5, t7, 0xEE);
+
+        _mm256_storeu_ps(out, _mm256_permute2f128_ps(q0, q4, 0x20));
+        _mm256_storeu_ps(out + stride, _mm256_permute2f128_ps(q1, q5, 0x20));
+        _mm256_storeu_ps(out + 2 * stride, _mm256_permute2f128_ps(q2, q6, 0x20));
+        _mm256_storeu_ps(out + 3 * stride, _mm256_permute2f128_ps(q3, q7, 0x20));
+        _mm256_storeu_ps(out + 4 * stride, _mm256_permute2f128_ps(q0, q4, 0x31));
+        _mm256_storeu_ps(out + 5 * stride, _mm256_permute2f128_ps(q1, q5, 0x31));
+        _mm256_storeu_ps(out + 6 * stride, _mm256_permute2f128_ps(q2, q6, 0x31));
+        _mm256_storeu_ps(out + 7 * stride, _mm256_permute2f128_ps(q3, q7, 0x31));
+    }
+
+    TESSELLATION_AVX2 inline std::uint32_t angleTableAvx2(std::uint32_t count, float start, float step, float* cosines, float* sines)
+    {
+        std::uint32_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 index = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32((int)i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+            __m256 s, c;
+            sincos8(_mm256_add_ps(_mm256_set1_ps(start), _mm256_mul_ps(index, _mm256_set1_ps(step))), s, c);
+            _mm256_storeu_ps(cosines + i, c);
+            _mm256_storeu_ps(sines + i, s);
+        }
+        return i;
+    }
+
+    TESSELLATION_AVX2 inline std::uint32_t sphereRowAvx2(std::uint32_t sectors, float xy, float z, float lengthInv, float t,
+                                                         const float* cosines, const float* sines, float* v)
+    {
+        __m256 vxy = _mm256_set1_ps(xy);
+        __m256 vz = _mm256_set1_ps(z);
+        __m256 vnz = _mm256_set1_ps(z * lengthInv);
+        __m256 vt = _mm256_set1_ps(t);
+        __m256 vlengthInv = _mm256_set1_ps(lengthInv);
+        __m256 vsectors = _mm256_set1_ps((float)sectors);
+
+        std::uint32_t j = 0;
+        for (; j + 8 <= sectors + 1; j += 8)
+        {
+            __m256 x = _mm256_mul_ps(vxy, _mm256_loadu_ps(cosines + j));
+            __m256 y = _mm256_mul_ps(vxy, _mm256_loadu_ps(sines + j));
+            __m256 s = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32((int)j), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7))), vsectors);
+            storeVertices8(v + j * 8, 8, x, y, vz, _mm256_mul_ps(x, vlengthInv), _mm256_mul_ps(y, vlengthInv), vnz, s, vt);
+        }
+        return j;
+    }
+
+    TESSELLATION_AVX2 inline std::uint32_t ringAvx2(std::uint32_t sectors, float radius, const RingVertex& ring,
+                                                    const float* cosines, const float* sines, float* v, std::size_t stride)
+    {
+        const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+        __m256 vradius = _mm256_set1_ps(radius * ring.onCircle);
+        __m256 radial = _mm256_castsi256_ps(_mm256_set1_epi32(ring.radial != 0 ? -1 : 0));
+        __m256 capUV = _mm256_castsi256_ps(_mm256_set1_epi32(ring.capUV != 0 ? -1 : 0));
+        __m256 half = _mm256_set1_ps(0.5f);
+
+        std::uint32_t j = 0;
+        for (; j + 8 <= sectors; j += 8)
+        {
+            __m256 ux = _mm256_loadu_ps(cosines + j + ring.next);
+            __m256 uy = _mm256_loadu_ps(sines + j + ring.next);
+            __m256 nx = _mm256_and_ps(radial, ux);
+            __m256 ny = _mm256_and_ps(radial, uy);
+            __m256 nz = _mm256_andnot_ps(radial, _mm256_set1_ps(ring.nz));
+            __m256 s = _mm256_add_ps(_mm256_mul_ps(_mm256_xor_ps(ux, signMask), half), half);
+            __m256 t = _mm256_add_ps(_mm256_mul_ps(_mm256_xor_ps(uy, signMask), half), half);
+            s = _mm256_blendv_ps(_mm256_set1_ps(ring.s), s, capUV);
+            t = _mm256_blendv_ps(_mm256_set1_ps(ring.t), t, capUV);
+            storeVertices8(v + j * stride, stride, _mm256_mul_ps(ux, vradius), _mm256_mul_ps(uy, vradius), _mm256_set1_ps(ring.h),
+                           nx, ny, nz, s, t);
+        }
+        return j;
+    }
+#endif // TESSELLATION_X86
+
+    // cos/sin of start + i * step for i in [0, count); returns how many entries were written
+    inline std::uint32_t angleTable(std::uint32_t count, float start, float step, float* cosines, float* sines)
+    {
+#ifdef TESSELLATION_X86
+        switch (activeIsa())
+        {
+        case Isa::AVX2: return angleTableAvx2(count, start, step, cosines, sines);
+        case Isa::SSE2: return angleTableSse2(count, start, step, cosines, sines);
+        default: break;
+        }
+#endif
+        return 0;
+    }
+
+    // One sphere stack row of sectors + 1 vertices; returns how many vertices were written
+    inline std::uint32_t sphereRow(std::uint32_t sectors, float xy, float z, float lengthInv, float t,
+                                   const float* cosines, const float* sines, float* v)
+    {
+#ifdef TESSELLATION_X86
+        switch (activeIsa())
+        {
+        case Isa::AVX2: return sphereRowAvx2(sectors, xy, z, lengthInv, t, cosines, sines, v);
+        case Isa::SSE2: return sphereRowSse2(sectors, xy, z, lengthInv, t, cosines, sines, v);
+        default: break;
+        }
+#endif
+        return 0;
+    }
+
+    // One vertex per sector written every stride floats; returns how many sectors were written
+    inline std::uint32_t ring(std::uint32_t sectors, float radius, const RingVertex& ringVertex,
+                              const float* cosines, const float* sines, float* v, std::size_t stride)
+    {
+#ifdef TESSELLATION_X86
+        switch (activeIsa())
+        {
+        case Isa::AVX2: return ringAvx2(sectors, radius, ringVertex, cosines, sines, v, stride);
+        case Isa::SSE2: return ringSse2(sectors, radius, ringVertex, cosines, sines, v, stride);
+        default: break;
+        }
+#endif
+        return 0;
+    }
+}
+}
+
+#endif // TESSELLATIONSIMD_H
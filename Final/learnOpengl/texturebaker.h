@@ -0,0 +1,393 @@
+#ifndef TEXTUREBAKER_H
+#define TEXTUREBAKER_H
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ktx2.h"
+#include "texturecache.h"
+#include "threadpool.h"
+
+// Offline conversion of the PNG and JPEG textures to block compressed KTX 2.0
+// files with their whole mip chain, written next to each image as
+// "<image>.ktx2". Images without transparency become BC1 (half a byte a texel),
+// the rest BC3 (one byte). The file records the hash of the image it was baked
+// from, so TextureCache only uses it while the image is unchanged.
+namespace TextureBaker
+{
+    // Expand a 5:6:5 color to 8 bits a channel
+    inline void unpack565(std::uint16_t color, int rgb[3])
+    {
+        rgb[0] = ((color >> 11) & 31) * 255 / 31;
+        rgb[1] = ((color >> 5) & 63) * 255 / 63;
+        rgb[2] = (color & 31) * 255 / 31;
+    }
+
+    inline std::uint16_t pack565(const float rgb[3])
+    {
+        int r = std::min(std::max((int)std::lround(rgb[0] * 31.0f / 255.0f), 0), 31);
+        int g = std::min(std::max((int)std::lround(rgb[1] * 63.0f / 255.0f), 0), 63);
+        int b = std::min(std::max((int)std::lround(rgb[2] * 31.0f / 255.0f), 0), 31);
+        return (std::uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    // Four-color palette of a BC1 block; color0 > color1 always, so there is no transparent entry
+    inline void palette(std::uint16_t color0, std::uint16_t color1, int colors[4][3])
+    {
+        unpack565(color0, colors[0]);
+        unpack565(color1, colors[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            colors[2][c] = (2 * colors[0][c] + colors[1][c]) / 3;
+            colors[3][c] = (colors[0][c] + 2 * colors[1][c]) / 3;
+        }
+    }
+
+    // Pick the nearest palette entry for each texel; returns the squared error
+    inline int assignIndices(const unsigned char texels[16][4], std::uint16_t color0, std::uint16_t color1, std::uint32_t& indices)
+    {
+        int colors[4][3];
+        palette(color0, color1, colors);
+        int error = 0;
+        indices = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; ++p)
+            {
+                int dr = texels[i][0] - colors[p][0], dg = texels[i][1] - colors[p][1], db = texels[i][2] - colors[p][2];
+                int e = dr * dr + dg * dg + db * db;
+                if (e < bestError)
+                {
+                    best = p;
+                    bestError = e;
+                }
+            }
+            indices |= (std::uint32_t)best << (2 * i);
+            error += bestError;
+        }
+        return error;
+    }
+
+    // Endpoints from the extent of the texels along their principal axis, then refit by least squares to the indices chosen
+    inline void encodeBC1(const unsigned char texels[16][4], unsigned char out[8])
+    {
+        float mean[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c)
+                mean[c] += texels[i][c] / 16.0f;
+
+        float covariance[6] = { 0, 0, 0, 0, 0, 0 };
+        for (int i = 0; i < 16; ++i)
+        {
+            float d[3] = { texels[i][0] - mean[0], texels[i][1] - mean[1], texels[i][2] - mean[2] };
+            covariance[0] += d[0] * d[0]; covariance[1] += d[0] * d[1]; covariance[2] += d[0] * d[2];
+            covariance[3] += d[1] * d[1]; covariance[4] += d[1] * d[2]; covariance[5] += d[2] * d[2];
+        }
+
+        // Power iteration for the axis of most variance
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+            float next[3] = { covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                              covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                              covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+            float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+            if (length < 1e-6f)
+                break;
+            for (int c = 0; c < 3; ++c)
+                axis[c] = next[c] / length;
+        }
+
+        float low = 1e30f, high = -1e30f;
+        for (int i = 0; i < 16; ++i)
+        {
+            float t = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1] + (texels[i][2] - mean[2]) * axis[2];
+            low = std::min(low, t);
+            high = std::max(high, t);
+        }
+        float end0[3], end1[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            end0[c] = mean[c] + axis[c] * high;
+            end1[c] = mean[c] + axis[c] * low;
+        }
+
+        std::uint16_t color0 = pack565(end0), color1 = pack565(end1);
+        std::uint32_t indices = 0;
+        int error = 1 << 30;
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            if (color0 < color1)
+                std::swap(color0, color1);
+            std::uint32_t passIndices = 0;
+            int passError = assignIndices(texels, color0, color1, passIndices);
+            if (color0 == color1)
+                passIndices = 0;    // Only palette entry 0 is defined as the color itself
+            if (passError >= error)
+                break;
+            out[0] = (unsigned char)(color0 & 0xFF);
+            out[1] = (unsigned char)(color0 >> 8);
+            out[2] = (unsigned char)(color1 & 0xFF);
+            out[3] = (unsigned char)(color1 >> 8);
+            indices = passIndices;
+            error = passError;
+
+            // Least squares endpoints for the weights the indices give each texel
+            const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+            float aa = 0, bb = 0, ab = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+            for (int i = 0; i < 16; ++i)
+            {
+                float a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+                aa += a * a; bb += b * b; ab += a * b;
+                for (int c = 0; c < 3; ++c)
+                {
+                    ax[c] += a * texels[i][c];
+                    bx[c] += b * texels[i][c];
+                }
+            }
+            float determinant = aa * bb - ab * ab;
+            if (std::fabs(determinant) < 1e-6f)
+                break;
+            for (int c = 0; c < 3; ++c)
+            {
+                end0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+                end1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+            }
+            color0 = pack565(end0);
+            color1 = pack565(end1);
+        }
+
+        std::memcpy(out + 4, &indices, 4);
+    }
+
+    // BC3 alpha block: eight levels between the block's extremes
+    inline void encodeBC3Alpha(const unsigned char texels[16][4], unsigned char out[8])
+    {
+        int alpha0 = 0, alpha1 = 255;
+        for (int i = 0; i < 16; ++i)
+        {
+            alpha0 = std::max(alpha0, (int)texels[i][3]);
+            alpha1 = std::min(alpha1, (int)texels[i][3]);
+        }
+
+        int levels[8] = { alpha0, alpha1 };
+        for (int i = 1; i < 7; ++i)
+            levels[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+
+        std::uint64_t indices = 0;
+        for (int i = 0; i < 16 && alpha0 != alpha1; ++i)
+        {
+            int best = 0;
+            for (int l = 1; l < 8; ++l)
+            {
+                if (std::abs(texels[i][3] - levels[l]) < std::abs(texels[i][3] - levels[best]))
+                    best = l;
+            }
+            indices |= (std::uint64_t)best << (3 * i);
+        }
+
+        out[0] = (unsigned char)alpha0;
+        out[1] = (unsigned char)alpha1;
+        for (int b = 0; b < 6; ++b)
+            out[2 + b] = (unsigned char)(indices >> (8 * b));
+    }
+
+    // Texels of the 4x4 block at (x, y); past the edge the last row and column repeat
+    inline void gatherBlock(const unsigned char* pixels, int width, int height, int channels, int x, int y, unsigned char texels[16][4])
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            int tx = std::min(x + i % 4, width - 1);
+            int ty = std::min(y + i / 4, height - 1);
+            const unsigned char* texel = pixels + ((size_t)ty * width + tx) * channels;
+            texels[i][0] = texel[0];
+            texels[i][1] = texel[1];
+            texels[i][2] = texel[2];
+            texels[i][3] = channels == 4 ? texel[3] : 255;
+        }
+    }
+
+    inline std::vector<unsigned char> compress(const unsigned char* pixels, int width, int height, int channels, std::uint32_t vkFormat)
+    {
+        std::vector<unsigned char> blocks(Ktx2::levelBytes(vkFormat, width, height));
+        unsigned char* out = blocks.data();
+        for (int y = 0; y < height; y += 4)
+        {
+            for (int x = 0; x < width; x += 4)
+            {
+                unsigned char texels[16][4];
+                gatherBlock(pixels, width, height, channels, x, y, texels);
+                if (vkFormat == Ktx2::k_FormatBC3)
+                {
+                    encodeBC3Alpha(texels, out);
+                    out += 8;
+                }
+                encodeBC1(texels, out);
+                out += 8;
+            }
+        }
+        return blocks;
+    }
+
+    // Decode blocks back to RGBA, to measure what compression lost
+    inline std::vector<unsigned char> decompress(const unsigned char* blocks, int width, int height, std::uint32_t vkFormat)
+    {
+        std::vector<unsigned char> pixels((size_t)width * height * 4);
+        for (int y = 0; y < height; y += 4)
+        {
+            for (int x = 0; x < width; x += 4)
+            {
+                int alphas[16];
+                std::fill(alphas, alphas + 16, 255);
+                if (vkFormat == Ktx2::k_FormatBC3)
+                {
+                    int alpha0 = blocks[0], alpha1 = blocks[1];
+                    int levels[8] = { alpha0, alpha1 };
+                    for (int i = 1; i < 7; ++i)
+                        levels[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+                    std::uint64_t indices = 0;
+                    for (int b = 0; b < 6; ++b)
+                        indices |= (std::uint64_t)blocks[2 + b] << (8 * b);
+                    for (int i = 0; i < 16; ++i)
+                        alphas[i] = levels[(indices >> (3 * i)) & 7];
+                    blocks += 8;
+                }
+
+                std::uint16_t color0 = (std::uint16_t)(blocks[0] | blocks[1] << 8);
+                std::uint16_t color1 = (std::uint16_t)(blocks[2] | blocks[3] << 8);
+                std::uint32_t indices;
+                std::memcpy(&indices, blocks + 4, 4);
+                int colors[4][3];
+                palette(color0, color1, colors);
+                blocks += 8;
+
+                for (int i = 0; i < 16; ++i)
+                {
+                    int tx = x + i % 4, ty = y + i / 4;
+                    if (tx >= width || ty >= height)
+                        continue;
+                    unsigned char* texel = pixels.data() + ((size_t)ty * width + tx) * 4;
+                    const int* color = colors[(indices >> (2 * i)) & 3];
+                    texel[0] = (unsigned char)color[0];
+                    texel[1] = (unsigned char)color[1];
+                    texel[2] = (unsigned char)color[2];
+                    texel[3] = (unsigned char)alphas[i];
+                }
+            }
+        }
+        return pixels;
+    }
+
+    // Peak signal to noise ratio of the decoded level 0 against the image, in dB
+    inline double psnr(const TextureImage& image, const std::vector<unsigned char>& decoded)
+    {
+        double squares = 0;
+        size_t texels = (size_t)image.width * image.height;
+        for (size_t i = 0; i < texels; ++i)
+        {
+            for (int c = 0; c < image.channels; ++c)
+            {
+                double d = (double)image.pixels.get()[i * image.channels + c] - decoded[i * 4 + c];
+                squares += d * d;
+            }
+        }
+        double mse = squares / (texels * image.channels);
+        return mse > 0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+    }
+
+    // Bake one image; the report line is only written when it returns true
+    inline bool bake(const std::string& path, std::string& report)
+    {
+        std::shared_ptr<MappedFile> file = MappedFile::open(path);
+        TextureImage image;
+        if (!file || !TextureCache::decodeImage(file->data(), file->size(), image))
+            return false;
+        if (image.channels != 3 && image.channels != 4)
+            return false;
+
+        bool transparent = false;
+        for (size_t i = 3; image.channels == 4 && i < (size_t)image.width * image.height * 4; i += 4)
+            transparent = transparent || image.pixels.get()[i] != 255;
+        std::uint32_t vkFormat = transparent ? Ktx2::k_FormatBC3 : Ktx2::k_FormatBC1;
+
+        // Rows are stored as decodeImage() leaves them, bottom row first, which KTXorientation "ru" records
+        buildMips(image);
+        std::vector<std::vector<unsigned char>> levels;
+        size_t bytes = 0;
+        for (int level = 0; level < image.levels(); ++level)
+        {
+            levels.push_back(compress(image.levelPixels(level), image.levelWidth(level), image.levelHeight(level), image.channels, vkFormat));
+            bytes += levels.back().size();
+        }
+
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)TextureCache::hash(file->data(), file->size()));
+        if (!Ktx2::write(path + ".ktx2", vkFormat, image.width, image.height, levels,
+                         { { "KTXorientation", "ru" }, { "KTXwriter", "Final texture baker" }, { k_BakedSourceHashKey, hash } }))
+            return false;
+
+        std::ostringstream line;
+        line << "INFO: Baked " << path << ": " << image.width << "x" << image.height << " " << (transparent ? "BC3" : "BC1") << ", "
+             << levels.size() << " levels, " << bytes / 1024 << " KB instead of " << TextureCache::textureBytes(image.width, image.height) / 1024
+             << " KB, PSNR " << psnr(image, decompress(levels[0].data(), image.width, image.height, vkFormat)) << " dB\n";
+        report = line.str();
+        return true;
+    }
+
+    // Images in a directory, by extension
+    inline std::vector<std::string> listImages(const std::string& directory)
+    {
+        std::vector<std::string> images;
+        for (const std::string& file : AssetArchive::listFiles(directory))
+        {
+            std::string name = file.substr(file.find_last_of('/') + 1);
+            std::string extension = name.substr(name.find_last_of('.') + 1);
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+            if (name.find('.') != std::string::npos && (extension == "png" || extension == "jpg" || extension == "jpeg"))
+                images.push_back(file);
+        }
+        return images;
+    }
+
+    // Bake every image in a directory on the worker threads; false if any failed
+    inline bool bakeDirectory(const std::string& directory, ThreadPool& pool)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::string> images = listImages(directory);
+        std::vector<std::future<std::string>> bakes;
+        for (const std::string& path : images)
+        {
+            bakes.push_back(pool.submit([path]
+            {
+                std::string report;
+                return bake(path, report) ? report : "WARNING: Could not bake " + path + "\n";
+            }));
+        }
+
+        bool success = true;
+        for (auto& result : bakes)
+        {
+            std::string report = result.get();
+            success = success && report.compare(0, 5, "INFO:") == 0;
+            std::cout << report;
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "INFO: Baked " << images.size() << " images in " << elapsed.count() << " s" << std::endl;
+        return success;
+    }
+}
+
+#endif // TEXTUREBAKER_H
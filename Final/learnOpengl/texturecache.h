@@ -0,0 +1,624 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <GL/glew.h>
+
+#include "ktx2.h"           // Baked, block compressed textures
+#include "assetarchive.h"   // Files from the mounted archive, else loose
+#include "textureimage.h"   // Decoded images and their mips
+#include "texturestreamer.h"    // Uploads large textures over several frames
+
+// Least image data each thread flipping an image gets; smaller images are flipped on the calling thread
+static const size_t k_FlipBandBytes = 4 << 20;
+
+// Key of the value in a baked file holding the hash of the image it was baked from
+static const char* const k_BakedSourceHashKey = "FinalSourceHash";
+
+// Texture uploaded from an image file; deleted with the last handle, on the context thread
+struct GLTexture
+{
+    GLuint id = 0;
+    GLenum target = GL_TEXTURE_2D;  // GL_TEXTURE_2D_ARRAY for TextureCache::uploadArray()
+    int width = 0;
+    int height = 0;
+    int layers = 1;
+    size_t bytes = 0;       // Estimated video memory, mips included
+    std::string path;       // Canonical path of the file it was first loaded from
+
+    // Residency, see TextureResidency
+    unsigned lastUsed = 0;  // Frame the texture was last bound in
+    int droppedLevels = 0;  // Top mip levels released to stay in budget; level 0 is then smaller than width x height
+    size_t fullBytes = 0;   // Bytes with every level, while some are dropped
+
+    ~GLTexture();
+};
+
+typedef std::shared_ptr<GLTexture> TextureHandle;
+
+// Hands out shared textures keyed by the contents of their file, so an image is
+// decoded and uploaded once however many objects, or paths, refer to it.
+// Entries are weak: a texture is deleted when the last object holding it goes away.
+//
+// Loading is split like Object::load()/upload(): load() maps, hashes and decodes
+// the file on any thread (concurrent loads of the same contents share one decode,
+// and contents already on the GPU are not decoded at all), and upload() turns it
+// into a texture on the context thread.
+//
+// An image with a baked "<image>.ktx2" beside it (see texturebaker.h) is not
+// decoded: its compressed levels are uploaded as they are, if the file was baked
+// from the same image bytes and the driver has S3TC.
+class TextureCache
+{
+public:
+    // Use baked textures where they are up to date; set before loading
+    static bool& useBaked()
+    {
+        static bool s_UseBaked = true;
+        return s_UseBaked;
+    }
+
+    struct Key
+    {
+        std::uint64_t hash;     // FNV-1a of the file's bytes
+        std::uint64_t size;
+
+        bool operator<(const Key& other) const
+        {
+            return std::tie(hash, size) < std::tie(other.hash, other.size);
+        }
+    };
+
+    // File loaded for upload()
+    struct Request
+    {
+        std::string path;       // Canonical
+        Key key;
+        std::shared_ptr<const TextureImage> image;  // Null when the texture was already resident
+    };
+
+    // Map, hash and, unless a live texture has the same contents, decode a file; safe on worker threads
+    static bool load(const char* filename, Request& request)
+    {
+        std::shared_ptr<MappedFile> file = AssetArchive::open(filename);
+        if (!file)
+            return false;
+
+        request.path = canonicalPath(filename);
+        request.key = { hash(file->data(), file->size()), file->size() };
+
+        std::promise<std::shared_ptr<const TextureImage>> promise;
+        PendingImage image;
+        bool decoder = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex());
+            auto entry = entries().find(request.key);
+            if (entry != entries().end() && !entry->second.expired())
+            {
+                request.image = nullptr;
+                return true;
+            }
+
+            auto found = pending().find(request.key);
+            if (found != pending().end())
+            {
+                image = found->second;
+            }
+            else
+            {
+                image = promise.get_future().share();
+                pending()[request.key] = image;
+                decoder = true;
+            }
+        }
+
+        if (decoder)
+        {
+            std::shared_ptr<TextureImage> decoded = std::make_shared<TextureImage>();
+            if (loadBaked(filename, request.key.hash, *decoded))
+            {
+                // Mips come from the file
+            }
+            else if (!decodeImage(file->data(), file->size(), *decoded))
+            {
+                decoded = nullptr;
+                std::lock_guard<std::mutex> lock(mutex());
+                pending().erase(request.key);
+            }
+            else if (TextureStreamer::streams(*decoded))
+            {
+                // Streamed levels come from the CPU, as glGenerateMipmap would need them all resident
+                buildMips(*decoded);
+            }
+            promise.set_value(decoded);
+        }
+
+        request.image = image.get();
+        return request.image != nullptr;
+    }
+
+    // Live texture for the request's contents, uploading its image if there is none; null on failure
+    static TextureHandle upload(const Request& request)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        std::weak_ptr<GLTexture>& entry = entries()[request.key];
+        TextureHandle texture = entry.lock();
+        if (texture)
+        {
+            ++stats().hits;
+            return texture;
+        }
+
+        // The request holds the decoded image from here on, so later loads, whether or not
+        // this upload succeeds, decode it afresh rather than reusing the copy
+        pending().erase(request.key);
+
+        // The texture load() found resident has gone since: decode it again here
+        std::shared_ptr<const TextureImage> image = request.image;
+        if (!image)
+        {
+            std::shared_ptr<TextureImage> decoded = std::make_shared<TextureImage>();
+            if (!loadBaked(request.path.c_str(), request.key.hash, *decoded) && !loadImage(request.path.c_str(), *decoded))
+                return nullptr;
+            if (TextureStreamer::streams(*decoded))
+                buildMips(*decoded);
+            image = decoded;
+        }
+
+        // Large images start at a coarse level and have the rest streamed by TextureStreamer::update()
+        bool streamed = !image->mips.empty();
+        GLuint textureId;
+        if (!(streamed ? TextureStreamer::createTexture(*image, textureId) : uploadTexture(*image, textureId)))
+            return nullptr;
+
+        ++stats().misses;
+        texture = std::make_shared<GLTexture>();
+        texture->id = textureId;
+        texture->width = image->width;
+        texture->height = image->height;
+        texture->bytes = image->compressedFormat ? compressedBytes(*image) : textureBytes(image->width, image->height);
+        texture->path = request.path;
+        stats().residentBytes += texture->bytes;
+        stats().peakBytes = std::max(stats().peakBytes, stats().residentBytes);
+        ++stats().residentTextures;
+        entry = texture;
+        if (streamed)
+            TextureStreamer::queue(texture, textureId, image, request.path);
+        return texture;
+    }
+
+    // Live array texture with one layer per request, in order, uploading it if there is none. Layers are
+    // resampled to the size of the first and must have as many channels; null on failure.
+    static TextureHandle uploadArray(const std::vector<Request>& layers)
+    {
+        if (layers.empty())
+            return nullptr;
+
+        // Keyed by the layers' contents and order, apart from the textures of the single images
+        Key key = { 0x41525241595f5458ull, 0 };     // "ARRAY_TX"
+        for (const Request& layer : layers)
+        {
+            key.hash = (key.hash ^ layer.key.hash) * 1099511628211ull;
+            key.size += layer.key.size;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex());
+        std::weak_ptr<GLTexture>& entry = entries()[key];
+        TextureHandle texture = entry.lock();
+        if (texture)
+        {
+            ++stats().hits;
+            return texture;
+        }
+
+        // As in upload(), the layers hold their decoded images from here on
+        for (const Request& layer : layers)
+        {
+            pending().erase(layer.key);
+        }
+
+        // load() skips decoding images that are resident as textures of their own
+        std::vector<std::shared_ptr<const TextureImage>> images;
+        for (const Request& layer : layers)
+        {
+            std::shared_ptr<const TextureImage> image = layer.image;
+            if (!image || !image->pixels)
+            {
+                // Baked layers have no pixels to copy into the array, so it is built from the source
+                std::shared_ptr<TextureImage> decoded = std::make_shared<TextureImage>();
+                if (!loadImage(layer.path.c_str(), *decoded))
+                    return nullptr;
+                image = decoded;
+            }
+            images.push_back(image);
+        }
+
+        const TextureImage& first = *images[0];
+        GLenum internalFormat, format;
+        if (!textureFormat(first.channels, internalFormat, format))
+        {
+            std::cout << "Not implemented to handle image with " << first.channels << " channels" << std::endl;
+            return nullptr;
+        }
+
+        GLuint textureId;
+        glGenTextures(1, &textureId);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, first.width, first.height, (GLsizei)images.size(), 0, format, GL_UNSIGNED_BYTE, nullptr);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            const TextureImage& image = *images[i];
+            if (image.channels != first.channels)
+            {
+                std::cout << "Texture array layer " << layers[i].path << " has " << image.channels << " channels, expected " << first.channels << std::endl;
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+                glDeleteTextures(1, &textureId);
+                return nullptr;
+            }
+
+            std::vector<unsigned char> resized;
+            const unsigned char* pixels = image.pixels.get();
+            if (image.width != first.width || image.height != first.height)
+            {
+                resized = resizeImage(image, first.width, first.height);
+                pixels = resized.data();
+            }
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)i, first.width, first.height, 1, format, GL_UNSIGNED_BYTE, pixels);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        ++stats().misses;
+        texture = std::make_shared<GLTexture>();
+        texture->id = textureId;
+        texture->target = GL_TEXTURE_2D_ARRAY;
+        texture->width = first.width;
+        texture->height = first.height;
+        texture->layers = (int)images.size();
+        texture->bytes = textureBytes(first.width, first.height) * images.size();
+        texture->path = layers[0].path;
+        stats().residentBytes += texture->bytes;
+        stats().peakBytes = std::max(stats().peakBytes, stats().residentBytes);
+        ++stats().residentTextures;
+        entry = texture;
+        return texture;
+    }
+
+    // Synchronous version for the context thread: load and upload in one call
+    static TextureHandle acquire(const char* filename)
+    {
+        Request request;
+        return load(filename, request) ? upload(request) : nullptr;
+    }
+
+    // Uploads that reused a live texture, and uploads that created one
+    static size_t hits() { return stats().hits; }
+    static size_t misses() { return stats().misses; }
+
+    // Textures alive and the video memory they are estimated to hold
+    static size_t residentTextures() { return stats().residentTextures; }
+    static size_t residentBytes() { return stats().residentBytes; }
+
+    // Most video memory textures held at once
+    static size_t peakBytes() { return stats().peakBytes; }
+
+    // Textures alive right now, e.g. to pick ones to shrink
+    static std::vector<TextureHandle> liveTextures()
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        std::vector<TextureHandle> textures;
+        for (const auto& entry : entries())
+        {
+            TextureHandle texture = entry.second.lock();
+            if (texture)
+                textures.push_back(texture);
+        }
+        return textures;
+    }
+
+    // Account for a texture whose storage was recreated at another size
+    static void updateBytes(GLTexture& texture, size_t bytes)
+    {
+        stats().residentBytes = stats().residentBytes - texture.bytes + bytes;
+        stats().peakBytes = std::max(stats().peakBytes, stats().residentBytes);
+        texture.bytes = bytes;
+    }
+
+    // Decode a file again, from its baked version when there is one; safe on worker threads
+    static std::shared_ptr<TextureImage> decodeFile(const std::string& path)
+    {
+        std::shared_ptr<MappedFile> file = AssetArchive::open(path);
+        if (!file)
+            return nullptr;
+
+        std::shared_ptr<TextureImage> image = std::make_shared<TextureImage>();
+        if (!loadBaked(path.c_str(), hash(file->data(), file->size()), *image) && !decodeImage(file->data(), file->size(), *image))
+            return nullptr;
+        return image;
+    }
+
+    static void report()
+    {
+        std::cout << "INFO: Texture cache: " << residentTextures() << " textures resident (" << residentBytes() / 1024 << " KB), "
+                  << hits() << " hits, " << misses() << " misses" << std::endl;
+    }
+
+    /*Generate and load the texture*/
+    static bool createTexture(const char* filename, GLuint& textureId)
+    {
+        TextureImage image;
+        return loadImage(filename, image) && uploadTexture(image, textureId);
+    }
+
+    /*Decode an image and flip it for OpenGL; safe to call from worker threads*/
+    static bool loadImage(const char* filename, TextureImage& image)
+    {
+        std::shared_ptr<MappedFile> file = AssetArchive::open(filename);
+        return file && decodeImage(file->data(), file->size(), image);
+    }
+
+    // Same for a file already in memory
+    static bool decodeImage(const unsigned char* bytes, size_t size, TextureImage& image)
+    {
+        unsigned char* pixels = stbi_load_from_memory(bytes, (int)size, &image.width, &image.height, &image.channels, 0);
+        if (!pixels)
+            return false;
+
+        image.pixels.reset(pixels);
+        flipImageVertically(pixels, image.width, image.height, image.channels);
+        return true;
+    }
+
+    /*Generate the texture from a decoded image*/
+    static bool uploadTexture(const TextureImage& image, GLuint& textureId)
+    {
+        if (image.compressedFormat)
+            return uploadCompressed(image, textureId);
+
+        GLenum internalFormat, format;
+        if (!textureFormat(image.channels, internalFormat, format))
+        {
+            std::cout << "Not implemented to handle image with " << image.channels << " channels" << std::endl;
+            return false;
+        }
+
+        glGenTextures(1, &textureId);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+
+        // set texture filtering parameters
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+
+        return true;
+    }
+
+    // Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it.
+    // Rows are swapped a chunk at a time with memcpy, and big images are split into bands of rows across threads.
+    static void flipImageVertically(unsigned char* image, int width, int height, int channels)
+    {
+        size_t rowBytes = (size_t)width * channels;
+        int pairs = height / 2;
+        auto swapRows = [=](int first, int last)
+        {
+            for (int j = first; j < last; ++j)
+            {
+                unsigned char* top = image + j * rowBytes;
+                unsigned char* bottom = image + (height - 1 - j) * rowBytes;
+                unsigned char chunk[4096];
+                for (size_t offset = 0; offset < rowBytes; offset += sizeof(chunk))
+                {
+                    size_t bytes = std::min(sizeof(chunk), rowBytes - offset);
+                    std::memcpy(chunk, top + offset, bytes);
+                    std::memcpy(top + offset, bottom + offset, bytes);
+                    std::memcpy(bottom + offset, chunk, bytes);
+                }
+            }
+        };
+
+        // Own threads rather than the pool: loadImage() already runs on pool workers
+        unsigned bands = (unsigned)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), rowBytes * height / k_FlipBandBytes);
+        bands = std::min(bands, (unsigned)std::max(pairs, 1));
+        if (bands <= 1)
+        {
+            swapRows(0, pairs);
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        for (unsigned band = 1; band < bands; ++band)
+        {
+            threads.emplace_back(swapRows, (int)((size_t)pairs * band / bands), (int)((size_t)pairs * (band + 1) / bands));
+        }
+        swapRows(0, pairs / (int)bands);
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    // Read "<filename>.ktx2" into an image of compressed levels if it was baked from contents with this hash
+    static bool loadBaked(const char* filename, std::uint64_t sourceHash, TextureImage& image)
+    {
+        if (!useBaked() || !GLEW_EXT_texture_compression_s3tc)
+            return false;
+
+        std::shared_ptr<MappedFile> file = AssetArchive::open((std::string(filename) + ".ktx2").c_str());
+        if (!file)
+            return false;
+
+        Ktx2::Header header;
+        std::vector<Ktx2::Level> levels;
+        if (!Ktx2::parse(file->data(), file->size(), header, levels))
+        {
+            std::cout << "WARNING: " << filename << ".ktx2 is not a baked texture, decoding the image instead" << std::endl;
+            return false;
+        }
+
+        // A stale file is ignored until it is baked again
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)sourceHash);
+        if (Ktx2::value(file->data(), file->size(), header, k_BakedSourceHashKey) != hash ||
+            Ktx2::value(file->data(), file->size(), header, "KTXorientation") != "ru")
+            return false;
+
+        image.width = (int)header.pixelWidth;
+        image.height = (int)header.pixelHeight;
+        image.channels = header.vkFormat == Ktx2::k_FormatBC1 ? 3 : 4;
+        image.compressedFormat = header.vkFormat == Ktx2::k_FormatBC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        for (const Ktx2::Level& level : levels)
+        {
+            image.compressedLevels.push_back({ level.width, level.height, level.data, level.size });
+        }
+        image.compressedStorage = file;
+        return true;
+    }
+
+    // Upload every level of a baked image as it is stored
+    static bool uploadCompressed(const TextureImage& image, GLuint& textureId)
+    {
+        glGenTextures(1, &textureId);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+
+        // set texture filtering parameters
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        for (size_t level = 0; level < image.compressedLevels.size(); ++level)
+        {
+            const CompressedLevel& mip = image.compressedLevels[level];
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, image.compressedFormat, mip.width, mip.height, 0, (GLsizei)mip.size, mip.data);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.compressedLevels.size() - 1);
+
+        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+
+        return true;
+    }
+
+    // 64-bit FNV-1a
+    static std::uint64_t hash(const unsigned char* bytes, size_t size)
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Mip chain of an 8-bit color texture; drivers pad RGB to four bytes a texel
+    static size_t textureBytes(int width, int height)
+    {
+        size_t bytes = 0;
+        for (;;)
+        {
+            bytes += (size_t)width * height * 4;
+            if (width == 1 && height == 1)
+                return bytes;
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+    }
+
+    // Levels of a baked image, which drivers keep compressed
+    static size_t compressedBytes(const TextureImage& image)
+    {
+        size_t bytes = 0;
+        for (const CompressedLevel& level : image.compressedLevels)
+        {
+            bytes += level.size;
+        }
+        return bytes;
+    }
+
+private:
+    friend struct GLTexture;
+
+    typedef std::shared_future<std::shared_ptr<const TextureImage>> PendingImage;
+
+    struct Stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t residentTextures = 0;
+        size_t residentBytes = 0;
+        size_t peakBytes = 0;
+    };
+
+    static std::string canonicalPath(const char* filename)
+    {
+#ifdef _WIN32
+        char* resolved = _fullpath(nullptr, filename, 0);
+#else
+        char* resolved = realpath(filename, nullptr);
+#endif
+        if (!resolved)
+            return filename;
+
+        std::string path(resolved);
+        std::free(resolved);
+        return path;
+    }
+
+    // Uploaded textures, guarded by mutex(); load() only checks whether they are alive
+    static std::map<Key, std::weak_ptr<GLTexture>>& entries()
+    {
+        static std::map<Key, std::weak_ptr<GLTexture>> s_Entries;
+        return s_Entries;
+    }
+
+    // Images decoded or being decoded, guarded by mutex()
+    static std::map<Key, PendingImage>& pending()
+    {
+        static std::map<Key, PendingImage> s_Pending;
+        return s_Pending;
+    }
+
+    static std::mutex& mutex()
+    {
+        static std::mutex s_Mutex;
+        return s_Mutex;
+    }
+
+    // Only touched on the context thread
+    static Stats& stats()
+    {
+        static Stats s_Stats;
+        return s_Stats;
+    }
+};
+
+inline GLTexture::~GLTexture()
+{
+    glDeleteTextures(1, &id);
+    TextureCache::stats().residentBytes -= bytes;
+    --TextureCache::stats().residentTextures;
+}
+
+#endif // TEXTURECACHE_H
@@ -0,0 +1,135 @@
+#ifndef TEXTUREIMAGE_H
+#define TEXTUREIMAGE_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <GL/glew.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>      // Image loading Utility functions
+
+// Mip level filtered on the CPU
+struct MipLevel
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+// Mip level of GPU blocks, pointing into storage the image holds on to
+struct CompressedLevel
+{
+    int width = 0;
+    int height = 0;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+// Decoded image waiting for upload
+struct TextureImage
+{
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::unique_ptr<unsigned char, void (*)(void*)> pixels{ nullptr, stbi_image_free };
+    std::vector<MipLevel> mips;     // Levels 1 and on, when built by buildMips() for streaming
+
+    // Block compressed levels, finest first, from a baked file; uploaded as they are, with no pixels decoded
+    GLenum compressedFormat = 0;
+    std::vector<CompressedLevel> compressedLevels;
+    std::shared_ptr<const void> compressedStorage;  // Keeps the levels' bytes alive
+
+    int levels() const { return 1 + (int)mips.size(); }
+    int levelWidth(int level) const { return level == 0 ? width : mips[level - 1].width; }
+    int levelHeight(int level) const { return level == 0 ? height : mips[level - 1].height; }
+    const unsigned char* levelPixels(int level) const { return level == 0 ? pixels.get() : mips[level - 1].pixels.data(); }
+};
+
+// GL formats for an 8-bit image; false for channel counts that are not handled
+inline bool textureFormat(int channels, GLenum& internalFormat, GLenum& format)
+{
+    if (channels == 3)
+    {
+        internalFormat = GL_RGB8;
+        format = GL_RGB;
+        return true;
+    }
+    if (channels == 4)
+    {
+        internalFormat = GL_RGBA8;
+        format = GL_RGBA;
+        return true;
+    }
+    return false;
+}
+
+// Bilinear resample of an image to another size, e.g. to match the other layers of an array texture
+inline std::vector<unsigned char> resizeImage(const TextureImage& image, int width, int height)
+{
+    const int channels = image.channels;
+    const unsigned char* source = image.pixels.get();
+    std::vector<unsigned char> resized((size_t)width * height * channels);
+    unsigned char* out = resized.data();
+    for (int y = 0; y < height; ++y)
+    {
+        // Texel centers line up, as a sampler would read them
+        float v = std::min(std::max((y + 0.5f) * image.height / height - 0.5f, 0.0f), image.height - 1.0f);
+        int y0 = (int)v;
+        int y1 = std::min(y0 + 1, image.height - 1);
+        float fy = v - y0;
+        for (int x = 0; x < width; ++x)
+        {
+            float u = std::min(std::max((x + 0.5f) * image.width / width - 0.5f, 0.0f), image.width - 1.0f);
+            int x0 = (int)u;
+            int x1 = std::min(x0 + 1, image.width - 1);
+            float fx = u - x0;
+            for (int c = 0; c < channels; ++c)
+            {
+                float top = source[((size_t)y0 * image.width + x0) * channels + c] * (1.0f - fx) + source[((size_t)y0 * image.width + x1) * channels + c] * fx;
+                float bottom = source[((size_t)y1 * image.width + x0) * channels + c] * (1.0f - fx) + source[((size_t)y1 * image.width + x1) * channels + c] * fx;
+                *out++ = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+    return resized;
+}
+
+// Box filter the full mip chain down to 1x1, each level from the one above; odd edges repeat their last texel
+inline void buildMips(TextureImage& image)
+{
+    image.mips.clear();
+    const int channels = image.channels;
+    int width = image.width;
+    int height = image.height;
+    const unsigned char* source = image.pixels.get();
+    while (width > 1 || height > 1)
+    {
+        MipLevel level;
+        level.width = std::max(width / 2, 1);
+        level.height = std::max(height / 2, 1);
+        level.pixels.resize((size_t)level.width * level.height * channels);
+
+        unsigned char* out = level.pixels.data();
+        for (int y = 0; y < level.height; ++y)
+        {
+            const unsigned char* row0 = source + (size_t)std::min(2 * y, height - 1) * width * channels;
+            const unsigned char* row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * channels;
+            for (int x = 0; x < level.width; ++x)
+            {
+                int x0 = std::min(2 * x, width - 1) * channels;
+                int x1 = std::min(2 * x + 1, width - 1) * channels;
+                for (int c = 0; c < channels; ++c)
+                {
+                    *out++ = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                }
+            }
+        }
+
+        image.mips.push_back(std::move(level));
+        source = image.mips.back().pixels.data();
+        width = image.mips.back().width;
+        height = image.mips.back().height;
+    }
+}
+
+#endif // TEXTUREIMAGE_H
@@ -0,0 +1,321 @@
+#ifndef TEXTURERESIDENCY_H
+#define TEXTURERESIDENCY_H
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <GL/glew.h>
+
+#include "texturecache.h"
+#include "texturestreamer.h"
+#include "threadpool.h"
+
+// Keeps the video memory of textures under a budget. Objects mark the textures
+// they bind with touch(); when the textures resident go over budget, update()
+// shrinks the least recently used ones by dropping their top mip levels, down to
+// k_MinSize, at which point a texture counts as evicted. Objects keep their
+// handles throughout, as the texture is recreated under the same GLTexture.
+// A dropped texture that is drawn again is decoded from its file on a worker
+// and put back at full size once that fits in the budget.
+class TextureResidency
+{
+public:
+    // Textures are never shrunk below this size, so there is always something to draw
+    static const int k_MinSize = TextureStreamer::k_ResidentSize;
+
+    // Full size reloads decoding at once
+    static const int k_MaxReloads = 2;
+
+    // Video memory textures may use, in bytes; 0 for no limit
+    static size_t& budget()
+    {
+        static size_t s_Budget = 0;
+        return s_Budget;
+    }
+
+    static size_t currentBytes() { return TextureCache::residentBytes(); }
+    static size_t peakBytes() { return TextureCache::peakBytes(); }
+
+    // Mark a texture used this frame; called whenever a draw binds it
+    static void touch(GLTexture& texture)
+    {
+        texture.lastUsed = frame();
+    }
+
+    // Finish reloads, then shrink or reload textures against the budget; call once a frame after the objects are drawn
+    static void update()
+    {
+        finishReloads();
+
+        if (budget() > 0)
+        {
+            std::vector<TextureHandle> textures = TextureCache::liveTextures();
+            if (currentBytes() > budget())
+                shrink(textures);
+            else
+                startReloads(textures);
+        }
+        ++frame();
+    }
+
+    static void report()
+    {
+        const Stats& counts = stats();
+        std::cout << "INFO: Texture residency: " << currentBytes() / 1024 << " KB resident, peak " << peakBytes() / 1024 << " KB, budget ";
+        if (budget() > 0)
+            std::cout << budget() / 1024 << " KB";
+        else
+            std::cout << "none";
+        std::cout << "; " << counts.drops << " shrunk, " << counts.evictions << " evicted, " << counts.reloads << " reloaded" << std::endl;
+    }
+
+    // Drop reloads still decoding; call before the context goes away
+    static void destroy()
+    {
+        reloads().clear();
+    }
+
+private:
+    struct Reload
+    {
+        std::weak_ptr<GLTexture> texture;
+        std::future<std::shared_ptr<TextureImage>> image;
+    };
+
+    struct Stats
+    {
+        size_t drops = 0;
+        size_t evictions = 0;
+        size_t reloads = 0;
+    };
+
+    // Only plain 2D textures that are done streaming have storage this can recreate
+    static bool managed(const GLTexture& texture)
+    {
+        return texture.target == GL_TEXTURE_2D && !TextureStreamer::streaming(texture.id);
+    }
+
+    // Width or height of level 0 as it is now, whichever is larger
+    static int currentSize(const GLTexture& texture)
+    {
+        return std::max(texture.width, texture.height) >> texture.droppedLevels;
+    }
+
+    // Least recently used first, dropping as few top levels from each as gets back under budget
+    static void shrink(std::vector<TextureHandle>& textures)
+    {
+        std::stable_sort(textures.begin(), textures.end(), [](const TextureHandle& a, const TextureHandle& b) { return a->lastUsed < b->lastUsed; });
+        for (const TextureHandle& texture : textures)
+        {
+            if (currentBytes() <= budget())
+                break;
+            if (!managed(*texture) || currentSize(*texture) <= k_MinSize)
+                continue;
+
+            // Each level dropped leaves about a quarter of the bytes
+            size_t over = currentBytes() - budget();
+            int levels = 0;
+            size_t remaining = texture->bytes;
+            while ((currentSize(*texture) >> levels) > k_MinSize && texture->bytes - remaining < over)
+            {
+                remaining /= 4;
+                ++levels;
+            }
+
+            size_t before = texture->bytes;
+            if (!dropLevels(*texture, levels))
+                continue;
+
+            bool evicted = currentSize(*texture) <= k_MinSize;
+            if (evicted)
+                ++stats().evictions;
+            else
+                ++stats().drops;
+            std::cout << "INFO: Texture " << texture->path.substr(texture->path.find_last_of("/\\") + 1) << (evicted ? " evicted" : " shrunk")
+                      << " to " << (texture->width >> texture->droppedLevels) << "x" << (texture->height >> texture->droppedLevels) << ", "
+                      << (before - texture->bytes) / 1024 << " KB freed, last used " << frame() - texture->lastUsed << " frames ago" << std::endl;
+        }
+    }
+
+    // Recreate a texture without its top levels, copying the rest back from the GPU. This stalls
+    // until the GPU is done with the texture, which is acceptable as it only happens over budget.
+    static bool dropLevels(GLTexture& texture, int levels)
+    {
+        if (levels <= 0)
+            return false;
+
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        GLint internalFormat = 0, compressed = 0, width = 0, height = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+
+        // Every texture has its whole chain down to 1x1
+        int count = 1;
+        for (int size = std::max(width, height); size > 1; size /= 2)
+            ++count;
+        if (levels >= count)
+            return false;
+
+        std::vector<MipLevel> kept(count - levels);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        for (int level = levels; level < count; ++level)
+        {
+            MipLevel& mip = kept[level - levels];
+            mip.width = std::max(width >> level, 1);
+            mip.height = std::max(height >> level, 1);
+            if (compressed)
+            {
+                GLint size = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                mip.pixels.resize(size);
+                glGetCompressedTexImage(GL_TEXTURE_2D, level, mip.pixels.data());
+            }
+            else
+            {
+                mip.pixels.resize((size_t)mip.width * mip.height * 4);
+                glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, mip.pixels.data());
+            }
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+        GLuint textureId;
+        glGenTextures(1, &textureId);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+
+        // set texture filtering parameters
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        size_t bytes = 0;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t level = 0; level < kept.size(); ++level)
+        {
+            const MipLevel& mip = kept[level];
+            if (compressed)
+            {
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, internalFormat, mip.width, mip.height, 0, (GLsizei)mip.pixels.size(), mip.pixels.data());
+                bytes += mip.pixels.size();
+            }
+            else
+            {
+                glTexImage2D(GL_TEXTURE_2D, (GLint)level, internalFormat, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, mip.pixels.data());
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)kept.size() - 1);
+        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+
+        if (!compressed)
+            bytes = TextureCache::textureBytes(kept[0].width, kept[0].height);
+
+        glDeleteTextures(1, &texture.id);
+        texture.id = textureId;
+        if (texture.droppedLevels == 0)
+            texture.fullBytes = texture.bytes;
+        texture.droppedLevels += levels;
+        TextureCache::updateBytes(texture, bytes);
+        return true;
+    }
+
+    // Decode textures drawn this frame at full size again, while what they add fits in the budget
+    static void startReloads(std::vector<TextureHandle>& textures)
+    {
+        // Bytes that reloads already decoding will add
+        size_t reserved = 0;
+        for (const Reload& reload : reloads())
+        {
+            TextureHandle texture = reload.texture.lock();
+            if (texture)
+                reserved += texture->fullBytes - texture->bytes;
+        }
+
+        for (const TextureHandle& texture : textures)
+        {
+            if (reloads().size() >= (size_t)k_MaxReloads)
+                break;
+            if (texture->droppedLevels == 0 || texture->lastUsed != frame() || reloading(*texture))
+                continue;
+
+            size_t extra = texture->fullBytes - texture->bytes;
+            if (currentBytes() + reserved + extra > budget())
+                continue;
+
+            Reload reload;
+            reload.texture = texture;
+            std::string path = texture->path;
+            reload.image = ThreadPool::shared().submit([path] { return TextureCache::decodeFile(path); });
+            reloads().push_back(std::move(reload));
+            reserved += extra;
+        }
+    }
+
+    static bool reloading(const GLTexture& texture)
+    {
+        for (const Reload& reload : reloads())
+        {
+            if (reload.texture.lock().get() == &texture)
+                return true;
+        }
+        return false;
+    }
+
+    // Swap in the full size textures whose decode is done, if they still fit
+    static void finishReloads()
+    {
+        std::vector<Reload>& pending = reloads();
+        for (size_t i = 0; i < pending.size();)
+        {
+            if (pending[i].image.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                ++i;
+                continue;
+            }
+
+            std::shared_ptr<TextureImage> image = pending[i].image.get();
+            TextureHandle texture = pending[i].texture.lock();
+            pending.erase(pending.begin() + i);
+            if (!image || !texture || texture->droppedLevels == 0)
+                continue;
+            if (budget() > 0 && currentBytes() - texture->bytes + texture->fullBytes > budget())
+                continue;
+
+            GLuint textureId;
+            if (!TextureCache::uploadTexture(*image, textureId))
+                continue;
+
+            glDeleteTextures(1, &texture->id);
+            texture->id = textureId;
+            texture->droppedLevels = 0;
+            TextureCache::updateBytes(*texture, image->compressedFormat ? TextureCache::compressedBytes(*image) : TextureCache::textureBytes(image->width, image->height));
+            ++stats().reloads;
+            std::cout << "INFO: Texture " << texture->path.substr(texture->path.find_last_of("/\\") + 1) << " reloaded at "
+                      << texture->width << "x" << texture->height << std::endl;
+        }
+    }
+
+    // Frames drawn so far
+    static unsigned& frame()
+    {
+        static unsigned s_Frame = 0;
+        return s_Frame;
+    }
+
+    static std::vector<Reload>& reloads()
+    {
+        static std::vector<Reload> s_Reloads;
+        return s_Reloads;
+    }
+
+    static Stats& stats()
+    {
+        static Stats s_Stats;
+        return s_Stats;
+    }
+};
+
+#endif // TEXTURERESIDENCY_H
@@ -0,0 +1,318 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+#include "textureimage.h"
+
+struct GLTexture;
+
+// Uploads the fine mip levels of large textures over several frames. A texture
+// is created with every level allocated but only the small ones filled, and
+// GL_TEXTURE_BASE_LEVEL pointing at the finest level filled so far. update()
+// then copies rows of the next finer level into a ring of pixel buffers, up to a
+// byte budget per frame, and lowers the base level as each level completes.
+// Fences keep a buffer from being rewritten while the GPU still reads it.
+class TextureStreamer
+{
+public:
+    // Levels this size and smaller are uploaded with the texture
+    static const int k_ResidentSize = 64;
+
+    // Pixel buffers in the ring, and the size of each; a slice is at most one buffer
+    static const int k_Buffers = 3;
+    static const size_t k_BufferBytes = 4 << 20;
+
+    // Stream textures instead of uploading them whole; set before the first upload
+    static bool& enabled()
+    {
+        static bool s_Enabled = false;
+        return s_Enabled;
+    }
+
+    // Most bytes copied to pixel buffers in one frame
+    static size_t& frameBudget()
+    {
+        static size_t s_Budget = 8 << 20;
+        return s_Budget;
+    }
+
+    // Whether an image is big enough to stream; such images have their mips built on the worker that decodes them.
+    // Baked images are already small enough to upload whole.
+    static bool streams(const TextureImage& image)
+    {
+        return enabled() && !image.compressedFormat && std::max(image.width, image.height) > k_ResidentSize;
+    }
+
+    // Create a texture with all levels allocated and the ones up to k_ResidentSize filled
+    static bool createTexture(const TextureImage& image, GLuint& textureId)
+    {
+        GLenum internalFormat, format;
+        if (!textureFormat(image.channels, internalFormat, format))
+        {
+            std::cout << "Not implemented to handle image with " << image.channels << " channels" << std::endl;
+            return false;
+        }
+
+        glGenTextures(1, &textureId);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+
+        // set texture filtering parameters
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        // Small mips have rows that are not a multiple of four bytes
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        int base = image.levels() - 1;
+        for (int level = 0; level < image.levels(); ++level)
+        {
+            bool resident = std::max(image.levelWidth(level), image.levelHeight(level)) <= k_ResidentSize;
+            if (resident)
+                base = std::min(base, level);
+            glTexImage2D(GL_TEXTURE_2D, level, internalFormat, image.levelWidth(level), image.levelHeight(level), 0, format, GL_UNSIGNED_BYTE,
+                         resident ? image.levelPixels(level) : nullptr);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels() - 1);
+        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+        return true;
+    }
+
+    // Stream the levels createTexture() left empty; the image is kept until they are all uploaded
+    static void queue(const std::shared_ptr<GLTexture>& texture, GLuint textureId, std::shared_ptr<const TextureImage> image, const std::string& name)
+    {
+        Job job;
+        job.texture = texture;
+        job.textureId = textureId;
+        job.image = std::move(image);
+        job.name = name.substr(name.find_last_of("/\\") + 1);
+        job.level = job.image->levels() - 1;
+        while (job.level >= 0 && std::max(job.image->levelWidth(job.level), job.image->levelHeight(job.level)) <= k_ResidentSize)
+            --job.level;
+        if (job.level >= 0)
+            jobs().push_back(std::move(job));
+    }
+
+    // Report how large a texture is on screen this frame, as a radius in pixels; bigger goes first
+    static void prioritize(GLuint textureId, float pixels)
+    {
+        for (Job& job : jobs())
+        {
+            if (job.textureId == textureId)
+                job.pixels = std::max(job.pixels, pixels);
+        }
+    }
+
+    // Whether a texture still has levels to come; its storage must stay as it is until they do
+    static bool streaming(GLuint textureId)
+    {
+        for (const Job& job : jobs())
+        {
+            if (job.textureId == textureId && !job.texture.expired())
+                return true;
+        }
+        return false;
+    }
+
+    // Upload this frame's slices; call once a frame on the context thread after the objects are drawn
+    static void update()
+    {
+        using Clock = std::chrono::steady_clock;
+        Stats& burst = stats();
+        Clock::time_point now = Clock::now();
+        if (burst.frames > 0)
+            burst.longestFrame = std::max(burst.longestFrame, std::chrono::duration<double, std::milli>(now - burst.lastUpdate).count());
+        burst.lastUpdate = now;
+
+        // Textures deleted before they finished need no more uploads
+        std::vector<Job>& pending = jobs();
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [](const Job& job) { return job.texture.expired(); }), pending.end());
+        if (pending.empty())
+        {
+            if (burst.frames > 0)
+            {
+                std::cout << "INFO: Texture streaming finished after " << burst.frames << " frames, " << burst.bytes / 1024
+                          << " KB in " << burst.slices << " slices, longest frame " << burst.longestFrame << " ms" << std::endl;
+                burst = Stats();
+            }
+            return;
+        }
+        ++burst.frames;
+
+        if (!buffers()[0].buffer)
+        {
+            for (Buffer& buffer : buffers())
+            {
+                glGenBuffers(1, &buffer.buffer);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.buffer);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, k_BufferBytes, nullptr, GL_STREAM_DRAW);
+            }
+        }
+
+        // Most under-resolved first: the on-screen diameter against the width of the level being streamed
+        for (Job& job : pending)
+        {
+            job.priority = 2.0f * job.pixels / job.image->levelWidth(job.level);
+            job.pixels = 0.0f;
+        }
+        std::stable_sort(pending.begin(), pending.end(), [](const Job& a, const Job& b) { return a.priority > b.priority; });
+
+        std::ostringstream log;
+        size_t uploaded = 0, slices = 0;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (Job& job : pending)
+        {
+            while (job.level >= 0 && uploaded < frameBudget())
+            {
+                // All buffers still being read: the GPU is behind, carry on next frame
+                Buffer* buffer = freeBuffer();
+                if (!buffer)
+                    break;
+
+                const TextureImage& image = *job.image;
+                int width = image.levelWidth(job.level);
+                int height = image.levelHeight(job.level);
+                size_t rowBytes = (size_t)width * image.channels;
+                size_t room = frameBudget() - uploaded;
+                if (room > k_BufferBytes)
+                    room = k_BufferBytes;
+                int rows = std::min(height - job.row, (int)(room / rowBytes));
+                if (rows == 0)
+                {
+                    // The budget is spent down to less than a row; a frame always makes some progress
+                    if (uploaded > 0)
+                        break;
+                    rows = 1;
+                }
+
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->buffer);
+                void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, rows * rowBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+                if (!mapped)
+                    break;
+                std::memcpy(mapped, image.levelPixels(job.level) + job.row * rowBytes, rows * rowBytes);
+                if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+                    break;  // Contents lost, e.g. a mode switch; the same rows are tried again next frame
+
+                GLenum internalFormat, format;
+                textureFormat(image.channels, internalFormat, format);
+                glBindTexture(GL_TEXTURE_2D, job.textureId);
+                glTexSubImage2D(GL_TEXTURE_2D, job.level, 0, job.row, width, rows, format, GL_UNSIGNED_BYTE, nullptr);
+                buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+                job.row += rows;
+                uploaded += rows * rowBytes;
+                ++slices;
+                if (job.row == height)
+                {
+                    // Level complete: sample it from now on
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job.level);
+                    log << ", " << job.name << " level " << job.level << " (" << width << "x" << height << ")";
+                    --job.level;
+                    job.row = 0;
+                }
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [](const Job& job) { return job.level < 0; }), pending.end());
+        burst.bytes += uploaded;
+        burst.slices += slices;
+
+        if (uploaded > 0)
+        {
+            std::cout << "INFO: Stream frame " << burst.frames << ": " << uploaded / 1024 << " KB in " << slices << " slices"
+                      << (log.tellp() > 0 ? ", done" : "") << log.str() << ", " << pending.size() << " textures pending" << std::endl;
+        }
+    }
+
+    // Release the pixel buffers and drop what is still queued; call before the context goes away
+    static void destroy()
+    {
+        for (Buffer& buffer : buffers())
+        {
+            if (buffer.fence)
+                glDeleteSync(buffer.fence);
+            glDeleteBuffers(1, &buffer.buffer);
+            buffer = Buffer();
+        }
+        jobs().clear();
+    }
+
+private:
+    struct Job
+    {
+        std::weak_ptr<GLTexture> texture;
+        GLuint textureId = 0;
+        std::shared_ptr<const TextureImage> image;
+        std::string name;           // File name, for the log
+        int level = 0;              // Level being uploaded; finer ones are still empty
+        int row = 0;                // Rows of it already uploaded
+        float pixels = 0.0f;        // Largest on-screen radius reported since the last update()
+        float priority = 0.0f;
+    };
+
+    struct Buffer
+    {
+        GLuint buffer = 0;
+        GLsync fence = 0;           // Set while the GPU may still be reading the buffer
+    };
+
+    // Totals for the current burst of streaming, reported when it ends
+    struct Stats
+    {
+        size_t frames = 0;
+        size_t bytes = 0;
+        size_t slices = 0;
+        double longestFrame = 0.0;  // Milliseconds between update() calls
+        std::chrono::steady_clock::time_point lastUpdate;
+    };
+
+    // Next buffer in the ring if the GPU is done with it
+    static Buffer* freeBuffer()
+    {
+        static int s_Next = 0;
+        Buffer& buffer = buffers()[s_Next];
+        if (buffer.fence)
+        {
+            GLenum status = glClientWaitSync(buffer.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                return nullptr;
+            glDeleteSync(buffer.fence);
+            buffer.fence = 0;
+        }
+        s_Next = (s_Next + 1) % k_Buffers;
+        return &buffer;
+    }
+
+    static std::vector<Job>& jobs()
+    {
+        static std::vector<Job> s_Jobs;
+        return s_Jobs;
+    }
+
+    static std::vector<Buffer>& buffers()
+    {
+        static std::vector<Buffer> s_Buffers(k_Buffers);
+        return s_Buffers;
+    }
+
+    static Stats& stats()
+    {
+        static Stats s_Stats;
+        return s_Stats;
+    }
+};
+
+#endif // TEXTURESTREAMER_H
@@ -0,0 +1,94 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running queued CPU jobs. Jobs must not touch
+// OpenGL: the context is only current on the main thread.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (unsigned i = 0; i < threads; ++i)
+        {
+            m_Workers.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stopping = true;
+        }
+        m_Wake.notify_all();
+
+        for (auto& worker : m_Workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queue a job; exceptions it throws are rethrown by the future's get()
+    template <typename Job>
+    auto submit(Job job) -> std::future<decltype(job())>
+    {
+        typedef decltype(job()) Result;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(job));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Jobs.emplace_back([task] { (*task)(); });
+        }
+        m_Wake.notify_one();
+        return result;
+    }
+
+    unsigned size() const { return (unsigned)m_Workers.size(); }
+
+    // Pool shared by the whole program, one worker per hardware thread
+    static ThreadPool& shared()
+    {
+        static ThreadPool s_Pool;
+        return s_Pool;
+    }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Wake.wait(lock, [this] { return m_Stopping || !m_Jobs.empty(); });
+                if (m_Jobs.empty())
+                    return;
+
+                job = std::move(m_Jobs.front());
+                m_Jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> m_Workers;
+    std::deque<std::function<void()>> m_Jobs;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    bool m_Stopping = false;
+};
+
+#endif // THREADPOOL_H
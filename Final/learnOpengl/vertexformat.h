@@ -0,0 +1,174 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Vertex layouts a mesh can be uploaded in. The generators always produce the
+// 32 byte float layout (position 3, normal 3, UV 2); the packed layouts are
+// converted from it at upload and take 16 bytes:
+//   0  position, 3 x half float or 3 x unorm16, plus 2 bytes of padding
+//   8  normal, signed normalized 2_10_10_10 (w unused)
+//   12 UV, 2 x unorm16
+enum class VertexFormat
+{
+    Float32,        // Float position, normal and UV
+    HalfPosition,   // Half float position
+    Quantized,      // Position quantized to 16 bits in the mesh's bounding cube, decoded by the model matrix
+};
+
+namespace VertexPacking
+{
+    struct PackedVertex
+    {
+        std::uint16_t position[4];
+        std::uint32_t normal;
+        std::uint16_t uv[2];
+    };
+    static_assert(sizeof(PackedVertex) == 16, "Packed vertices must stay 16 bytes");
+
+    // Packed vertices plus how to get the original positions back:
+    // position = positionOffset + positionScale * decoded
+    struct PackedMesh
+    {
+        std::vector<PackedVertex> vertices;
+        float positionScale = 1.0f;
+        float positionOffset[3] = { 0.0f, 0.0f, 0.0f };
+    };
+
+    inline const char* formatName(VertexFormat format)
+    {
+        switch (format)
+        {
+        case VertexFormat::HalfPosition: return "half";
+        case VertexFormat::Quantized: return "quantized";
+        default: return "float";
+        }
+    }
+
+    inline size_t vertexSize(VertexFormat format)
+    {
+        return format == VertexFormat::Float32 ? 8 * sizeof(float) : sizeof(PackedVertex);
+    }
+
+    // IEEE half float, rounded to nearest
+    inline std::uint16_t packHalf(float value)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, 4);
+
+        std::uint16_t sign = (std::uint16_t)((bits >> 16) & 0x8000);
+        int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+        std::uint32_t mantissa = bits & 0x7fffff;
+
+        if (exponent >= 31)
+            return sign | 0x7c00;   // Too large: infinity
+
+        if (exponent <= 0)
+        {
+            // Subnormal half, or zero when it is too small even for that
+            if (exponent < -10)
+                return sign;
+
+            mantissa |= 0x800000;
+            std::uint32_t shift = 14 - exponent;
+            std::uint32_t half = mantissa >> shift;
+            if ((mantissa >> (shift - 1)) & 1)
+                ++half;
+            return sign | (std::uint16_t)half;
+        }
+
+        // A carry out of the mantissa correctly rounds up into the exponent
+        std::uint32_t half = ((std::uint32_t)exponent << 10) | (mantissa >> 13);
+        if (mantissa & 0x1000)
+            ++half;
+        return sign | (std::uint16_t)half;
+    }
+
+    inline std::uint16_t packUnorm16(float value)
+    {
+        return (std::uint16_t)std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f);
+    }
+
+    inline std::uint32_t packSnorm10(float value)
+    {
+        return (std::uint32_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * 511.0f) & 0x3ff;
+    }
+
+    // x in the low bits, as GL_INT_2_10_10_10_REV expects
+    inline std::uint32_t packNormal(float x, float y, float z)
+    {
+        return packSnorm10(x) | (packSnorm10(y) << 10) | (packSnorm10(z) << 20);
+    }
+
+    // Decode parameters for packing float vertices; fails if the UVs leave [0, 1], which unorm16 cannot hold
+    inline bool packParameters(const float* vertices, size_t vertexCount, VertexFormat format, float& positionScale, float positionOffset[3])
+    {
+        float low[3] = { 0.0f, 0.0f, 0.0f };
+        float high[3] = { 0.0f, 0.0f, 0.0f };
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            const float* vertex = vertices + i * 8;
+            if (vertex[6] < 0.0f || vertex[6] > 1.0f || vertex[7] < 0.0f || vertex[7] > 1.0f)
+                return false;
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                low[axis] = i == 0 ? vertex[axis] : std::min(low[axis], vertex[axis]);
+                high[axis] = i == 0 ? vertex[axis] : std::max(high[axis], vertex[axis]);
+            }
+        }
+
+        positionScale = 1.0f;
+        std::fill(positionOffset, positionOffset + 3, 0.0f);
+        if (format == VertexFormat::Quantized)
+        {
+            // One scale for all axes, so the model matrix stays a similarity and normals are unaffected
+            float extent = std::max(high[0] - low[0], std::max(high[1] - low[1], high[2] - low[2]));
+            positionScale = extent > 0.0f ? extent : 1.0f;
+            std::copy(low, low + 3, positionOffset);
+        }
+        return true;
+    }
+
+    // Pack float vertices into caller storage, such as a mapped GL buffer, with packParameters()' results
+    inline void pack(const float* vertices, size_t vertexCount, VertexFormat format, float positionScale, const float positionOffset[3],
+                     PackedVertex* packed)
+    {
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            const float* vertex = vertices + i * 8;
+            PackedVertex out;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                if (format == VertexFormat::Quantized)
+                    out.position[axis] = packUnorm16((vertex[axis] - positionOffset[axis]) / positionScale);
+                else
+                    out.position[axis] = packHalf(vertex[axis]);
+            }
+            out.position[3] = 0;
+            out.normal = packNormal(vertex[3], vertex[4], vertex[5]);
+            out.uv[0] = packUnorm16(vertex[6]);
+            out.uv[1] = packUnorm16(vertex[7]);
+
+            // One whole store per vertex: the destination may be write-combined memory
+            std::memcpy(packed + i, &out, sizeof(out));
+        }
+    }
+
+    // Convert float vertices to a packed format; fails if the UVs leave [0, 1]
+    inline bool pack(const float* vertices, size_t vertexCount, VertexFormat format, PackedMesh& packed)
+    {
+        if (!packParameters(vertices, vertexCount, format, packed.positionScale, packed.positionOffset))
+            return false;
+
+        packed.vertices.resize(vertexCount);
+        pack(vertices, vertexCount, format, packed.positionScale, packed.positionOffset, packed.vertices.data());
+        return true;
+    }
+}
+
+#endif // VERTEXFORMAT_H
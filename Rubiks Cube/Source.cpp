@@ -5,6 +5,8 @@
 
 #include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
+#include <algorithm>        // min
+#include <cstring>          // memcpy
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 #define STB_IMAGE_IMPLEMENTATION
@@ -130,13 +132,14 @@ void flipImageVertically(unsigned char* image, int width, int height, int channe
         int index1 = j * width * channels;
         int index2 = (height - 1 - j) * width * channels;
 
-        for (int i = width * channels; i > 0; --i)
+        // Swap the rows a chunk at a time rather than byte by byte
+        unsigned char chunk[4096];
+        for (int offset = 0; offset < width * channels; offset += sizeof(chunk))
         {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
+            int bytes = std::min((int)sizeof(chunk), width * channels - offset);
+            memcpy(chunk, image + index1 + offset, bytes);
+            memcpy(image + index1 + offset, image + index2 + offset, bytes);
+            memcpy(image + index2 + offset, chunk, bytes);
         }
     }
 }